@@ -0,0 +1,81 @@
+#include "check_common.h"
+
+// adaptive_pam_map through block size changes, by set_block_size and by
+// retune, with batch and point updates between them, checked against a
+// std::map after every step.
+
+// Compares the underlying map, so that the comparison is not counted in the
+// workload that retune goes by.
+template <class Map>
+bool same_adaptive(const Map& m, const ref_map& ref) {
+  return m.visit([&] (const auto& x) { return same(x, ref); });
+}
+
+template <class Map>
+bool check_adaptive_map(const std::string& name) {
+  size_t n = 50000;
+  size_t range = 4 * n;
+  auto S = parlay::tabulate(n, [] (size_t i) { return par(2*i, i); });
+  Map m(S, 16);
+  ref_map ref;
+  for (size_t i = 0; i < n; i++) ref[2*i] = i;
+  bool ok = m.block_size() == 16 && same_adaptive(m, ref);
+
+  // Requested sizes round up to the next available one, or the largest.
+  size_t requested[] = {64, 100, 1000, 32, 16, 256, 17};
+  size_t expected[] = {64, 128, 256, 32, 16, 256, 32};
+  for (size_t step = 0; step < 7; step++) {
+    m.set_block_size(requested[step]);
+    ok &= m.block_size() == expected[step] && same_adaptive(m, ref);
+
+    // Distinct keys, since 7919 is coprime with range.
+    auto batch = parlay::tabulate(n / 5, [&] (size_t i) {
+      return par((i * 7919 + step * 104729) % range, step * n + i); });
+    m.multi_insert(batch);
+    for (auto& [k, v] : batch) ref[k] = v;
+    ok &= same_adaptive(m, ref);
+
+    auto keys = parlay::tabulate(n / 10, [&] (size_t i) {
+      return 3 * i + step; });
+    m.multi_delete_sorted(keys);
+    for (size_t k : keys) ref.erase(k);
+    ok &= same_adaptive(m, ref);
+
+    m.insert(par(range + step, step));
+    m.remove(3 * step + 1);
+    ref[range + step] = step;
+    ref.erase(3 * step + 1);
+    ok &= same_adaptive(m, ref);
+  }
+
+  // Scans favor the largest blocks.
+  m.set_block_size(16);
+  m.reset_workload();
+  for (size_t r = 0; r < 4; r++) ok &= m.entries().size() == ref.size();
+  ok &= m.retune() && m.block_size() == 256 && same_adaptive(m, ref);
+
+  // Otherwise retune moves to the size the cost model prefers, once the
+  // work since the last rebuild reaches the size of the map.
+  ok &= !m.retune();
+  size_t reads = m.size();
+  for (size_t k = 0; k < reads; k++) {
+    ok &= m.find(k).has_value() == (ref.count(k) > 0);
+  }
+  auto batch = parlay::tabulate(n / 5, [&] (size_t i) {
+    return par(2*i + 1, i); });
+  m.multi_insert(batch);
+  for (auto& [k, v] : batch) ref[k] = v;
+  size_t preferred = Map::preferred_block_size(m.get_workload(), m.size());
+  ok &= m.retune() == (preferred != 256);
+  ok &= m.block_size() == preferred && same_adaptive(m, ref);
+
+  std::cout << name << (ok ? ": ok" : ": differs from std::map") << std::endl;
+  return ok;
+}
+
+int main() {
+  bool ok = check_adaptive_map<cpam::adaptive_pam_map<entry>>("adaptive_pam_map");
+  ok &= check_adaptive_map<cpam::adaptive_pam_map<entry, cpam::diffencoded_entry_encoder>>(
+      "adaptive_pam_map (diff encoded)");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+
+#include <cpam/cpam.h>
+#include <parlay/primitives.h>
+
+// What the checks share: an entry with size_t keys and values (and a max
+// augmentation, so every map type can use it), the std::map that results are
+// compared with, and a driver running a check over the common map types.
+
+struct entry {
+  using key_t = size_t;
+  using val_t = size_t;
+  using aug_t = size_t;
+  static inline bool comp(key_t a, key_t b) { return a < b; }
+  static aug_t get_empty() { return 0; }
+  static aug_t from_entry(key_t k, val_t v) { return v; }
+  static aug_t combine(aug_t a, aug_t b) { return std::max(a, b); }
+};
+
+using par = std::tuple<size_t, size_t>;
+using ref_map = std::map<size_t, size_t>;
+
+// Whether m holds exactly the entries of ref.
+template <class Map>
+bool same(const Map& m, const ref_map& ref) {
+  if (m.size() != ref.size()) return false;
+  auto entries = Map::entries(m);
+  size_t i = 0;
+  for (auto& [k, v] : ref) {
+    if (std::get<0>(entries[i]) != k || std::get<1>(entries[i]) != v) {
+      return false;
+    }
+    i++;
+  }
+  return true;
+}
+
+template <class Map>
+struct map_type { using type = Map; };
+
+// Calls check(map_type<Map>(), name) for pam_map, diff_encoded_map and
+// aug_map, and returns whether all of them passed.
+template <class Check>
+bool check_maps(const Check& check) {
+  bool ok = true;
+  ok &= check(map_type<cpam::pam_map<entry, 64>>(), "pam_map");
+  ok &= check(map_type<cpam::diff_encoded_map<entry, 64>>(), "diff_encoded_map");
+  ok &= check(map_type<cpam::aug_map<entry, 64>>(), "aug_map");
+  return ok;
+}
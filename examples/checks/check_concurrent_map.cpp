@@ -0,0 +1,40 @@
+#include <atomic>
+
+#include "check_common.h"
+
+// Point updates to a concurrent_map from inside parlay::parallel_for,
+// checked after flush(), with lookups of keys that are always present going
+// on meanwhile. Each key is updated by one iteration, whose updates are
+// applied in the order it made them.
+
+using integer_map = cpam::pam_map<entry, 32>;
+
+int main() {
+  size_t n = 200000;
+  auto entries = parlay::tabulate(n, [] (size_t i) { return par(2*i, 0); });
+  cpam::concurrent_map<integer_map> m{integer_map(entries)};
+
+  std::atomic<bool> missing = false;
+  // Every iteration inserts a new odd key; every third one then removes it
+  // again, and every fifth one replaces the value of an existing even key.
+  parlay::parallel_for(0, n, [&] (size_t i) {
+    m.insert(par(2*i + 1, i));
+    if (i % 3 == 0) m.remove(2*i + 1);
+    if (i % 5 == 0) m.insert(par(2*i, i));
+    if (!m.contains(2*((i * 7919) % n))) missing = true;
+  }, 1);
+  m.flush();
+
+  auto result = integer_map::entries(m.snapshot());
+  size_t expected = n + n - (n + 2) / 3;
+  bool ok = !missing && result.size() == expected;
+  for (size_t j = 0; ok && j < result.size(); j++) {
+    auto [k, v] = result[j];
+    size_t i = k / 2;
+    if (k % 2 == 1) ok = (i % 3 != 0) && v == i;
+    else ok = v == ((i % 5 == 0) ? i : 0);
+  }
+  std::cout << "check_concurrent_map: " << (ok ? "ok" : "FAILED") << " ("
+            << m.num_batches() << " batches)" << std::endl;
+  return ok ? 0 : 1;
+}
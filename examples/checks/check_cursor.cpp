@@ -0,0 +1,76 @@
+#include <random>
+#include <string>
+
+#include "check_common.h"
+
+// Forward and backward scans, seeks and mixed steps of map cursors, checked
+// against std::map. A cursor keeps reading the version it was created from.
+
+template <class Map>
+bool check_cursor(const std::string& name) {
+  size_t n = 50000;
+  auto entries = parlay::tabulate(n, [] (size_t i) { return par(3*i, i); });
+  ref_map ref;
+  for (size_t i = 0; i < n; i++) ref[3*i] = i;
+  Map m(entries);
+
+  bool ok = true;
+  auto fail = [&] (const std::string& what) {
+    std::cout << name << ": " << what << " is wrong" << std::endl;
+    ok = false;
+  };
+  auto at = [] (const typename Map::cursor& c, ref_map::iterator it) {
+    return c.valid() && c.key() == it->first && std::get<1>(c.entry()) == it->second;
+  };
+
+  auto c = m.get_cursor();
+  // Later updates to m do not reach the cursor.
+  m = Map::remove(std::move(m), 0);
+  m.insert(par(1, 1));
+
+  auto it = ref.begin();
+  for (bool more = c.seek_first(); more; more = c.next(), ++it) {
+    if (it == ref.end() || !at(c, it)) { fail("forward scan"); break; }
+  }
+  if (it != ref.end()) fail("forward scan");
+
+  auto rit = ref.rbegin();
+  for (bool more = c.seek_last(); more; more = c.prev(), ++rit) {
+    if (rit == ref.rend() || !at(c, std::prev(rit.base()))) { fail("backward scan"); break; }
+  }
+  if (rit != ref.rend()) fail("backward scan");
+
+  std::mt19937_64 gen(1);
+  for (size_t r = 0; r < 1000; r++) {
+    size_t k = gen() % (3*n + 10);
+    auto pos = ref.lower_bound(k);
+    bool found = c.seek(k);
+    if (found != (pos != ref.end()) || (found && !at(c, pos))) { fail("seek"); break; }
+    // a short random walk from the seek position
+    for (size_t s = 0; s < 200 && found; s++) {
+      if (gen() % 3) {
+        ++pos;
+        found = c.next();
+        if (found != (pos != ref.end())) { fail("next"); break; }
+      } else {
+        if (pos == ref.begin()) {
+          if (c.prev()) fail("prev");
+          break;
+        }
+        --pos;
+        found = c.prev();
+      }
+      if (found && !at(c, pos)) { fail("step"); break; }
+    }
+  }
+
+  if (ok) std::cout << name << ": ok" << std::endl;
+  return ok;
+}
+
+int main() {
+  bool ok = check_maps([] (auto t, const std::string& name) {
+    return check_cursor<typename decltype(t)::type>(name);
+  });
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,95 @@
+#include <random>
+#include <string>
+#include <vector>
+
+#include "check_common.h"
+
+// Diffs between versions of a map that share most of their subtrees, and
+// between independently built maps, checked against a merge of std::maps.
+
+// 'i', 'd' or 'u', the key, and the (new) value, in key order.
+using change = std::tuple<char, size_t, size_t>;
+
+std::vector<change> ref_diff(const ref_map& a, const ref_map& b) {
+  std::vector<change> out;
+  auto i = a.begin();
+  auto j = b.begin();
+  while (i != a.end() || j != b.end()) {
+    if (j == b.end() || (i != a.end() && i->first < j->first)) {
+      out.emplace_back('d', i->first, i->second);
+      ++i;
+    } else if (i == a.end() || j->first < i->first) {
+      out.emplace_back('i', j->first, j->second);
+      ++j;
+    } else {
+      if (i->second != j->second) out.emplace_back('u', j->first, j->second);
+      ++i;
+      ++j;
+    }
+  }
+  return out;
+}
+
+template <class Map>
+std::vector<change> map_diff(const Map& a, const Map& b) {
+  std::vector<change> out;
+  Map::diff(a, b,
+      [&] (const auto& e) { out.emplace_back('i', std::get<0>(e), std::get<1>(e)); },
+      [&] (const auto& e) { out.emplace_back('d', std::get<0>(e), std::get<1>(e)); },
+      [&] (const auto& o, const auto& e) {
+        out.emplace_back('u', std::get<0>(e), std::get<1>(e)); });
+  return out;
+}
+
+template <class Map>
+bool check_diff(const std::string& name) {
+  size_t n = 100000;
+  auto entries = parlay::tabulate(n, [] (size_t i) { return par(2*i, i); });
+  ref_map ra;
+  for (size_t i = 0; i < n; i++) ra[2*i] = i;
+  Map a(entries);
+
+  bool ok = true;
+  std::mt19937_64 gen(1);
+  for (size_t changes : {0, 1, 10, 1000, 50000}) {
+    Map b = a;
+    ref_map rb = ra;
+    for (size_t r = 0; r < changes; r++) {
+      size_t k = gen() % (2*n + 10);
+      switch (gen() % 3) {
+        case 0: {
+          size_t v = gen() % 4;
+          b.insert(par(k, v));
+          rb[k] = v;
+          break;
+        }
+        case 1:
+          b = Map::remove(std::move(b), k);
+          rb.erase(k);
+          break;
+        default:  // may write the value the key already has
+          if (rb.count(k)) {
+            size_t v = rb[k] + gen() % 2;
+            b.insert(par(k, v));
+            rb[k] = v;
+          }
+      }
+    }
+    ok &= map_diff(a, b) == ref_diff(ra, rb);
+    ok &= map_diff(b, a) == ref_diff(rb, ra);
+    // the same contents without shared subtrees
+    Map c(Map::entries(b));
+    ok &= map_diff(b, c).empty();
+    ok &= map_diff(a, c) == ref_diff(ra, rb);
+  }
+
+  std::cout << name << (ok ? ": ok" : ": diff is wrong") << std::endl;
+  return ok;
+}
+
+int main() {
+  bool ok = check_maps([] (auto t, const std::string& name) {
+    return check_diff<typename decltype(t)::type>(name);
+  });
+  return ok ? 0 : 1;
+}
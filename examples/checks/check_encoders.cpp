@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <set>
+#include <random>
+#include <string>
+
+#include <parlay/random.h>
+
+#include "check_common.h"
+
+// Builds, point updates, lookups and set operations on maps using each of
+// the block encoders, checked against std::map. Values are a function of the
+// key, so it does not matter which side of a union a value comes from.
+
+static size_t value_of(size_t k) { return 3*k + 1; }
+
+// Keys with runs of consecutive values, dense stretches and sparse stretches,
+// so that every block form of the encoders shows up.
+parlay::sequence<size_t> make_keys(size_t n, size_t seed) {
+  std::mt19937_64 gen(seed);
+  parlay::sequence<size_t> keys;
+  size_t k = 0;
+  while (keys.size() < n) {
+    switch (gen() % 3) {
+      case 0:  // a run
+        for (size_t j = 0, len = 1 + gen() % 300; j < len; j++) keys.push_back(k++);
+        break;
+      case 1:  // dense
+        for (size_t j = 0, len = 1 + gen() % 300; j < len; j++) {
+          k += 1 + gen() % 3;
+          keys.push_back(k);
+        }
+        break;
+      default:  // sparse
+        for (size_t j = 0, len = 1 + gen() % 300; j < len; j++) {
+          k += 1 + gen() % 100000;
+          keys.push_back(k);
+        }
+    }
+  }
+  keys.resize(n);
+  return keys;
+}
+
+template <class Map>
+Map build(const parlay::sequence<size_t>& keys, ref_map& ref) {
+  auto entries = parlay::map(keys, [] (size_t k) { return par(k, value_of(k)); });
+  for (size_t k : keys) ref[k] = value_of(k);
+  return Map(parlay::random_shuffle(entries));
+}
+
+template <class Map>
+bool check_map(const std::string& name) {
+  bool ok = true;
+  auto fail = [&] (const std::string& what) {
+    std::cout << name << ": " << what << " is wrong" << std::endl;
+    ok = false;
+  };
+
+  ref_map ra, rb;
+  auto keys_a = make_keys(20000, 1);
+  auto keys_b = make_keys(20000, 2);
+  Map a = build<Map>(keys_a, ra);
+  Map b = build<Map>(keys_b, rb);
+  if (!same(a, ra) || !same(b, rb)) fail("build");
+
+  for (size_t i = 0; i < keys_a.size(); i += 97) {
+    auto v = a.find(keys_a[i]);
+    if (!v || *v != value_of(keys_a[i])) fail("find");
+    if (a.find(keys_a[i] + 1).has_value() != (ra.count(keys_a[i] + 1) > 0)) fail("find");
+  }
+
+  Map c = a;
+  ref_map rc = ra;
+  std::mt19937_64 gen(3);
+  for (size_t i = 0; i < 2000; i++) {
+    size_t k = gen() % (keys_a.back() + 10);
+    if (gen() % 2) {
+      c.insert(par(k, value_of(k)));
+      rc[k] = value_of(k);
+    } else {
+      c = Map::remove(std::move(c), k);
+      rc.erase(k);
+    }
+  }
+  if (!same(c, rc)) fail("insert/remove");
+  if (!same(a, ra)) fail("persistence");
+
+  ref_map ru = ra, ri, rd;
+  for (auto& [k, v] : rb) ru[k] = v;
+  for (auto& [k, v] : ra) {
+    if (rb.count(k)) ri[k] = v; else rd[k] = v;
+  }
+  if (!same(Map::map_union(a, b), ru)) fail("union");
+  if (!same(Map::map_intersect(a, b), ri)) fail("intersect");
+  if (!same(Map::map_difference(a, b), rd)) fail("difference");
+
+  if (ok) std::cout << name << ": ok" << std::endl;
+  return ok;
+}
+
+// In-place value updates, for encoders that store the values as an array.
+template <class Map>
+bool check_inplace(const std::string& name) {
+  ref_map ref;
+  auto keys = make_keys(20000, 6);
+  Map m = build<Map>(keys, ref);
+  auto updates = parlay::tabulate(keys.size() / 5, [&] (size_t i) {
+    return std::pair<size_t, size_t>(keys[5*i], i); });
+  Map::multi_update_sorted_inplace(m, updates, [] (size_t a, size_t b) { return a + b; });
+  for (auto& [k, v] : updates) ref[k] += v;
+  bool ok = same(m, ref);
+  std::cout << name << (ok ? ": ok" : ": in-place update is wrong") << std::endl;
+  return ok;
+}
+
+// Sets of keys with runs and dense stretches take the block set operations
+// of encoders that have them.
+template <class Set>
+bool check_set(const std::string& name) {
+  bool ok = true;
+  auto fail = [&] (const std::string& what) {
+    std::cout << name << ": " << what << " is wrong" << std::endl;
+    ok = false;
+  };
+  auto same = [] (const Set& s, const std::set<size_t>& ref) {
+    auto keys = Set::entries(s);
+    return keys.size() == ref.size() && std::equal(keys.begin(), keys.end(), ref.begin());
+  };
+
+  auto keys_a = make_keys(20000, 4);
+  auto keys_b = make_keys(20000, 5);
+  std::set<size_t> ra(keys_a.begin(), keys_a.end()), rb(keys_b.begin(), keys_b.end());
+  Set a(parlay::random_shuffle(keys_a));
+  Set b(parlay::random_shuffle(keys_b));
+  if (!same(a, ra) || !same(b, rb)) fail("build");
+
+  std::set<size_t> ru, ri, rd;
+  std::set_union(ra.begin(), ra.end(), rb.begin(), rb.end(), std::inserter(ru, ru.end()));
+  std::set_intersection(ra.begin(), ra.end(), rb.begin(), rb.end(), std::inserter(ri, ri.end()));
+  std::set_difference(ra.begin(), ra.end(), rb.begin(), rb.end(), std::inserter(rd, rd.end()));
+  if (!same(Set::map_union(a, b), ru)) fail("union");
+  if (!same(Set::map_intersect(a, b), ri)) fail("intersect");
+  if (!same(Set::map_difference(a, b), rd)) fail("difference");
+
+  if (ok) std::cout << name << ": ok" << std::endl;
+  return ok;
+}
+
+int main() {
+  bool ok = true;
+  ok &= check_map<cpam::bitpacked_map<entry, 64>>("bitpacked_map");
+  ok &= check_map<cpam::bitpacked_aug_map<entry, 64>>("bitpacked_aug_map");
+  ok &= check_map<cpam::pam_map<entry, 64, cpam::hybrid_entry_encoder>>("hybrid map");
+  ok &= check_map<cpam::aug_map<entry, 64, cpam::hybrid_entry_encoder>>("hybrid aug_map");
+  ok &= check_set<cpam::pam_set<entry, 64, cpam::hybrid_entry_encoder>>("hybrid set");
+
+  using cpam::composite_entry_encoder;
+  using diff_varint = composite_entry_encoder<cpam::diffencoded_entry_encoder,
+                                              cpam::varint_value_codec>;
+  using bitpacked_raw = composite_entry_encoder<cpam::bitpacked_entry_encoder,
+                                                cpam::raw_value_codec>;
+  using hybrid_dict = composite_entry_encoder<cpam::hybrid_entry_encoder,
+                                              cpam::dictionary_value_codec>;
+  ok &= check_map<cpam::pam_map<entry, 64, diff_varint>>("composite diff/varint map");
+  ok &= check_map<cpam::aug_map<entry, 64, diff_varint>>("composite diff/varint aug_map");
+  ok &= check_map<cpam::pam_map<entry, 64, bitpacked_raw>>("composite bitpacked/raw map");
+  ok &= check_map<cpam::pam_map<entry, 64, hybrid_dict>>("composite hybrid/dictionary map");
+  ok &= check_inplace<cpam::aug_map<entry, 64, bitpacked_raw>>("composite bitpacked/raw aug_map");
+  return ok ? 0 : 1;
+}
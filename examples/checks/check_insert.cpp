@@ -0,0 +1,33 @@
+#include "check_common.h"
+
+// Point inserts into compressed leaves, checked against std::map. A key that
+// lands before an existing entry of a leaf must not drop that entry.
+
+using integer_map = cpam::pam_map<entry, 32>;
+
+int main() {
+  size_t n = 10000;
+  auto entries = parlay::tabulate(n, [&] (size_t i) { return par(2*i, i); });
+  integer_map m(entries);
+  ref_map ref;
+  for (size_t i = 0; i < n; i++) ref[2*i] = i;
+
+  bool ok = true;
+  // Every odd key falls strictly between two existing keys.
+  for (size_t i = 0; i < n; i += 7) {
+    m.insert(par(2*i + 1, i));
+    ref[2*i + 1] = i;
+  }
+  ok &= same(m, ref);
+
+  // Functional inserts leave the old version unchanged.
+  auto m2 = integer_map::insert(m, par(2*n + 1, 0));
+  auto m3 = integer_map::insert(m, par(3, 0));
+  ok &= same(m, ref);
+  ref[3] = 0;
+  ok &= same(m3, ref);
+  ok &= (m2.size() == m.size() + 1);
+
+  std::cout << (ok ? "check_insert: ok" : "check_insert: FAILED") << std::endl;
+  return ok ? 0 : 1;
+}
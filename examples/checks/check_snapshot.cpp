@@ -0,0 +1,54 @@
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+
+#include "check_common.h"
+
+// Saves maps to on-disk snapshots, opens them again and updates the opened
+// maps, checked against std::map. Updates must copy the mapped nodes, so
+// reopening the file gives back the saved map.
+
+template <class Map>
+bool check_snapshot(const std::string& name, const std::string& path) {
+  size_t n = 100000;
+  auto entries = parlay::tabulate(n, [] (size_t i) { return par(3*i, i); });
+  ref_map ref;
+  for (size_t i = 0; i < n; i++) ref[3*i] = i;
+  Map m(entries);
+  m.save(path);
+
+  bool ok = true;
+  auto fail = [&] (const std::string& what) {
+    std::cout << name << ": " << what << " is wrong" << std::endl;
+    ok = false;
+  };
+
+  Map s = Map::open(path);
+  if (!same(s, ref)) fail("open");
+  for (size_t i = 0; i < n; i += 101) {
+    auto v = s.find(3*i);
+    if (!v || *v != i) fail("find");
+  }
+
+  ref_map ref2 = ref;
+  for (size_t i = 0; i < n; i += 13) {
+    s.insert(par(3*i + 1, i));
+    ref2[3*i + 1] = i;
+    s = Map::remove(std::move(s), 3*i);
+    ref2.erase(3*i);
+  }
+  if (!same(s, ref2)) fail("update");
+  if (!same(Map::open(path), ref)) fail("reopen after update");
+
+  unlink(path.c_str());
+  if (ok) std::cout << name << ": ok" << std::endl;
+  return ok;
+}
+
+int main() {
+  std::string prefix = "/tmp/cpam_check_snapshot_" + std::to_string(getpid());
+  bool ok = check_maps([&] (auto t, const std::string& name) {
+    return check_snapshot<typename decltype(t)::type>(name, prefix + "_" + name);
+  });
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,43 @@
+#include "check_common.h"
+
+// Operation counters, built with -DCPAM_STATS. A multi_insert into a map
+// that is still shared decodes, encodes and allocates blocks, an insert into
+// a shared map copies its path, and a find that stops at the first entry of
+// a block decodes none in full.
+
+template <class Map>
+bool check_stats(const std::string& name) {
+  size_t n = 100000;
+  Map m(parlay::tabulate(n, [] (size_t i) { return par(2*i, i); }));
+  auto batch = parlay::tabulate(n / 10, [] (size_t i) { return par(20*i + 1, i); });
+
+  Map::reset_op_stats();
+  Map m2 = Map::multi_insert(m, batch);
+  auto c = Map::op_stats();
+  bool ok = m2.size() == n + n / 10;
+  ok &= c.decodes > 0 && c.encodes > 0 && c.bytes_encoded > 0;
+  ok &= c.allocs > 0;
+
+  Map::reset_op_stats();
+  Map m3 = m2;
+  m3.insert(par(3, 3));
+  ok &= m3.size() == m2.size() + 1 && Map::op_stats().path_copies > 0;
+
+  Map::reset_op_stats();
+  ok &= m2.find(0, n) == 0 && Map::op_stats().decodes == 0;
+
+  Map::reset_op_stats();
+  m2 = Map();
+  m3 = Map();
+  ok &= Map::op_stats().frees > 0;
+
+  std::cout << name << (ok ? ": ok" : ": counts are wrong") << std::endl;
+  return ok;
+}
+
+int main() {
+  bool ok = check_maps([] (auto t, const std::string& name) {
+    return check_stats<typename decltype(t)::type>(name);
+  });
+  return ok ? 0 : 1;
+}
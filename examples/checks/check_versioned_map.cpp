@@ -0,0 +1,65 @@
+#include <optional>
+#include <vector>
+
+#include "check_common.h"
+
+// Readers holding old versions while many more are committed, and updates
+// from inside parlay::parallel_for, some of them applying a whole batch with
+// a (parallel) multi_insert. Every update adds keys no other update adds, so
+// the latest version must hold all of them.
+
+using integer_map = cpam::pam_map<entry, 32>;
+
+int main() {
+  cpam::versioned_map<integer_map> vm;
+  bool ok = true;
+
+  // Many more versions than are live at once, with some of them kept by
+  // readers while the slot table is rebuilt; the slots of the others are
+  // reused.
+  size_t n = 50000;
+  std::vector<std::optional<cpam::versioned_map<integer_map>::version>> held;
+  for (size_t i = 1; i <= n; i++) {
+    vm.update([&] (const integer_map& m) { return integer_map::insert(m, par(i, i)); });
+    if (i % 10000 == 0) held.push_back(vm.acquire_latest());
+  }
+  for (auto& v : held) {
+    ok &= v->map().size() == v->get_timestamp();
+  }
+  for (auto& v : held) {
+    auto again = vm.acquire_at(v->get_timestamp());
+    ok &= again.has_value() && again->map().size() == v->get_timestamp();
+  }
+  ok &= !vm.acquire_at(5).has_value();  // neither latest nor held
+  ok &= !vm.acquire_at(n - 1).has_value();
+  ok &= vm.num_slots() <= 64;
+  held.clear();
+
+  // Concurrent updates: none may be overwritten.
+  size_t k = 2000;
+  parlay::parallel_for(0, k, [&] (size_t i) {
+    vm.update([&] (const integer_map& m) {
+      return integer_map::insert(m, par(n + 1 + i, i)); });
+  }, 1);
+  ok &= vm.acquire_latest().map().size() == n + k;
+
+  // Concurrent batch updates, each a multi_insert large enough to run in
+  // parallel, while point updates go on.
+  size_t batches = 200, batch_size = 5000;
+  size_t first = 2*n + 2*k;
+  parlay::parallel_for(0, batches, [&] (size_t b) {
+    auto batch = parlay::tabulate(batch_size, [&] (size_t j) {
+      return par(first + b * batch_size + j, b); });
+    vm.update([&] (const integer_map& m) { return integer_map::multi_insert(m, batch); });
+    vm.update([&] (const integer_map& m) {
+      return integer_map::insert(m, par(first + batches * batch_size + b, b)); });
+  }, 1);
+  auto latest = vm.acquire_latest();
+  ok &= latest.map().size() == n + k + batches * (batch_size + 1);
+  for (size_t b = 0; b < batches; b += 17) {
+    ok &= latest.map().find(first + b * batch_size + batch_size - 1) == std::optional<size_t>(b);
+  }
+
+  std::cout << "check_versioned_map: " << (ok ? "ok" : "FAILED") << std::endl;
+  return ok ? 0 : 1;
+}
@@ -68,17 +68,19 @@ typedef double fType;
   }
 
   template <class Graph>
-  auto BC(Graph& G, const uintE& start, bool use_flatsnap=true) {
+  auto BC(Graph& G, const uintE& start, bool use_flatsnap=true,
+          const typename Graph::flat_snap_t* snapshot=nullptr) {
     using W = typename Graph::weight_type;
     size_t n = G.num_vertices();
 
-    using edge_node = typename Graph::edge_node;
-    parlay::sequence<edge_node*> fs;
-    if (use_flatsnap) {
+    using flat_snap_t = typename Graph::flat_snap_t;
+    flat_snap_t own_fs;
+    if (use_flatsnap && !snapshot) {
       timer t; t.start();
-      fs = G.fetch_all_vertices();
+      own_fs = G.fetch_all_vertices();
       t.next("Snapshot time");
     }
+    const flat_snap_t& fs = snapshot ? *snapshot : own_fs;
 
     auto NumPaths = parlay::sequence<fType>(n, 0.0);
     auto Visited = parlay::sequence<bool>(n, false);
@@ -8,6 +8,7 @@
 //     -c : indicate that the graph is compressed
 //     -m : indicate that the graph should be mmap'd
 //     -s : indicate that the graph is symmetric
+//     -d : read the graph as directed; the BFS follows out-edges
 
 #include "BFS.h"
 #include "aspen/aspen.h"
@@ -25,7 +26,8 @@ double BFS_runner(Graph& G, cpam::commandLine P) {
   std::cout << "### Threads: " << parlay::num_workers() << std::endl;
   std::cout << "### n: " << G.num_vertices() << std::endl;
   std::cout << "### m: " << G.num_edges() << std::endl;
-  std::cout << "### Params: -src = " << src << " flatsnap = " << flatsnap << std::endl;
+  std::cout << "### Params: -src = " << src << " flatsnap = " << flatsnap
+            << " directed = " << Graph::is_directed << std::endl;
   std::cout << "### ------------------------------------" << std::endl;
   std::cout << "### ------------------------------------" << std::endl;
 
@@ -39,4 +41,4 @@ double BFS_runner(Graph& G, cpam::commandLine P) {
 
 }  // namespace aspen
 
-generate_symmetric_aspen_main(aspen::BFS_runner, false);
+generate_aspen_main(aspen::BFS_runner, false);
@@ -20,18 +20,19 @@ struct BFS_F {
 
 template <class Graph>
 inline parlay::sequence<uintE> BFS(Graph& G, uintE src, bool
-    flatsnap=false) {
+    flatsnap=false, const typename Graph::flat_snap_t* snapshot=nullptr) {
   using W = typename Graph::weight_type;
   size_t n = G.num_vertices();
-  using edge_node = typename Graph::edge_node;
+  using flat_snap_t = typename Graph::flat_snap_t;
 
-  parlay::sequence<edge_node*> fs;
-  if (flatsnap) {
+  flat_snap_t own_fs;
+  if (flatsnap && !snapshot) {
     timer st;
     st.start();
-    fs = G.fetch_all_vertices();
+    own_fs = G.fetch_all_vertices();
     st.next("Snapshot time");
   }
+  const flat_snap_t& fs = snapshot ? *snapshot : own_fs;
 
   auto Parents = parlay::sequence<uintE>(n, UINT_E_MAX);
   Parents[src] = src;
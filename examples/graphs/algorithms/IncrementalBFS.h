@@ -0,0 +1,241 @@
+#pragma once
+
+#include "aspen/aspen.h"
+
+namespace aspen {
+
+// Maintains the BFS distances from a single source across the versions
+// produced by batches of edge updates, given each batch and the version it
+// produced. Edges are followed from source to target (out-edges), so the
+// graph may be symmetric or directed.
+//
+// Inserting edges only shortens distances: the targets of inserted edges
+// that got closer are relaxed, and the decreases are pushed out along the
+// out-edges with edgeMap. Deleting edges only lengthens them: a vertex whose
+// every in-neighbor at distance d-1 lost its edge, or its own distance, is
+// invalidated, level by level from the deleted edges; each invalidated
+// vertex then takes one more than the distance of its closest valid
+// in-neighbor and the decreases are pushed out as for insertions. Batches
+// larger than recompute_fraction * m, and deletions that invalidate more
+// than recompute_fraction * n vertices, fall back to a BFS from scratch.
+template <class Graph>
+struct IncrementalBFS {
+  using W = typename Graph::weight_type;
+  using flat_snap_t = typename Graph::flat_snap_t;
+  static constexpr uintE kInf = UINT_E_MAX;
+
+  IncrementalBFS(Graph& G, uintE src, double recompute_fraction = 0.05)
+      : src(src), recompute_fraction(recompute_fraction) {
+    recompute(G);
+  }
+
+  // The distance of every vertex from the source (UINT_E_MAX if it is not
+  // reachable).
+  const parlay::sequence<uintE>& distances() const { return dist; }
+
+  uintE distance(uintE v) const { return (v < dist.size()) ? dist[v] : kInf; }
+
+  void recompute(Graph& G) {
+    size_t n = G.num_vertices();
+    dist = parlay::sequence<uintE>(n, kInf);
+    mark = parlay::sequence<uintE>(n, 0);
+    invalid = parlay::sequence<bool>(n, false);
+    if (src < n) {
+      dist[src] = 0;
+      vertexSubset frontier(n, src);
+      for (uintE round = 1; !frontier.isEmpty(); round++) {
+        frontier = G.edgeMap(frontier, visit_F{dist.begin(), round}, -1,
+                             sparse_blocked | dense_parallel);
+      }
+    }
+    recomputes++;
+  }
+
+  // G is the version produced by inserting the m edges.
+  template <class Edge>
+  void insert_edges(Graph& G, size_t m, Edge* edges) {
+    if (m > recompute_fraction * G.num_edges()) return recompute(G);
+    grow(G.num_vertices());
+    auto seeds = relax_edges(m, edges);
+    propagate(G, std::move(seeds));
+  }
+
+  // G is the version produced by deleting the m edges. The optional flat
+  // snapshot of G speeds up fetching the vertices to check.
+  template <class Edge>
+  void delete_edges(Graph& G, size_t m, Edge* edges,
+                    const flat_snap_t* snapshot = nullptr) {
+    if (m > recompute_fraction * G.num_edges()) return recompute(G);
+    grow(G.num_vertices());
+    size_t n = dist.size();
+    auto get_vertex = [&] (uintE v) {
+      return (snapshot && v < snapshot->size())
+          ? typename Graph::vertex(v, (*snapshot)[v]) : G.get_vertex(v);
+    };
+
+    // Targets of deleted edges that may have lost their parent, by level.
+    auto cands = parlay::filter(parlay::delayed_seq<uintE>(m, [&] (size_t i) {
+      uintE u = std::get<0>(edges[i]), v = std::get<1>(edges[i]);
+      bool tree_edge = u < n && v < n && v != src && dist[u] != kInf &&
+                       dist[v] == dist[u] + 1;
+      return tree_edge ? v : kInf;
+    }), [] (uintE v) { return v != kInf; });
+    parlay::sort_inplace(cands, [&] (uintE a, uintE b) {
+      return std::make_pair(dist[a], a) < std::make_pair(dist[b], b); });
+
+    // Invalidate level by level: a candidate at level d stays if a valid
+    // in-neighbor is at level d-1; otherwise its out-neighbors at level d+1
+    // become candidates. Levels below d are final when d is checked.
+    parlay::sequence<uintE> invalidated;
+    parlay::sequence<uintE> level_cands;
+    size_t next_cand = 0;
+    while (next_cand < cands.size() || level_cands.size() > 0) {
+      uintE d = (level_cands.size() > 0) ? dist[level_cands[0]] : dist[cands[next_cand]];
+      if (level_cands.size() == 0 || (next_cand < cands.size() && dist[cands[next_cand]] == d)) {
+        size_t end = next_cand;
+        while (end < cands.size() && dist[cands[end]] == d) end++;
+        level_cands.append(cands.cut(next_cand, end));
+        next_cand = end;
+      }
+      level_cands = dedup(std::move(level_cands));
+      auto lost = parlay::filter(level_cands, [&] (uintE v) {
+        bool supported = false;
+        auto check_f = [&] (const uintE& v, const uintE& ngh, const W& wgh) {
+          if (!invalid[ngh] && dist[ngh] + 1 == d) supported = true;
+          return !supported;
+        };
+        get_vertex(v).in_neighbors().foreach_cond(check_f);
+        return !supported;
+      });
+      parlay::parallel_for(0, lost.size(), [&] (size_t i) { invalid[lost[i]] = true; });
+      invalidated.append(lost);
+      if (invalidated.size() > recompute_fraction * n) {
+        parlay::parallel_for(0, invalidated.size(), [&] (size_t i) {
+          invalid[invalidated[i]] = false; });
+        return recompute(G);
+      }
+
+      auto children = parlay::map(lost, [&] (uintE v) {
+        auto out = parlay::sequence<uintE>();
+        auto child_f = [&] (const uintE& v, const uintE& ngh, const W& wgh) {
+          if (dist[ngh] == d + 1) out.push_back(ngh);
+          return true;
+        };
+        get_vertex(v).out_neighbors().foreach_cond(child_f);
+        return out;
+      });
+      level_cands = parlay::flatten(children);
+    }
+
+    // Restart the invalidated vertices from their closest valid in-neighbor.
+    parlay::parallel_for(0, invalidated.size(), [&] (size_t i) {
+      dist[invalidated[i]] = kInf; });
+    auto seeds = parlay::filter(invalidated, [&] (uintE v) {
+      uintE best = kInf;
+      auto min_f = [&] (const uintE& v, const uintE& ngh, const W& wgh) {
+        if (!invalid[ngh] && dist[ngh] != kInf) best = std::min(best, dist[ngh] + 1);
+        return true;
+      };
+      get_vertex(v).in_neighbors().foreach_cond(min_f);
+      dist[v] = best;
+      return best != kInf;
+    });
+    parlay::parallel_for(0, invalidated.size(), [&] (size_t i) {
+      invalid[invalidated[i]] = false; });
+    propagate(G, std::move(seeds));
+  }
+
+  // The number of times the distances were recomputed from scratch.
+  size_t num_recomputes() const { return recomputes; }
+
+ private:
+  uintE src;
+  double recompute_fraction;
+  parlay::sequence<uintE> dist;
+  parlay::sequence<uintE> mark;  // last relaxation round that added a vertex
+  parlay::sequence<bool> invalid;  // scratch for delete_edges, kept all false
+  uintE round = 0;
+  size_t recomputes = 0;
+
+  // Sets the distance of unvisited vertices.
+  struct visit_F {
+    uintE* dist;
+    uintE round;
+    inline bool update(const uintE& s, const uintE& d, const W& w) {
+      dist[d] = round;
+      return 1;
+    }
+    inline bool updateAtomic(const uintE& s, const uintE& d, const W& w) {
+      return cpam::utils::atomic_compare_and_swap(&dist[d], kInf, round);
+    }
+    inline bool cond(const uintE& d) const { return dist[d] == kInf; }
+  };
+
+  // Lowers the distance of d to one more than that of s, adding d to the
+  // next frontier once per round.
+  struct relax_F {
+    uintE* dist;
+    uintE* mark;
+    uintE round;
+    inline bool update(const uintE& s, const uintE& d, const W& w) {
+      if (dist[s] == kInf || dist[s] + 1 >= dist[d]) return 0;
+      dist[d] = dist[s] + 1;
+      return 1;
+    }
+    inline bool updateAtomic(const uintE& s, const uintE& d, const W& w) {
+      return write_min(&dist[d], dist[s]) && first_in_round(d);
+    }
+    inline bool cond(const uintE& d) const { return true; }
+
+    bool write_min(uintE* a, uintE s_dist) {
+      if (s_dist == kInf) return false;
+      uintE nd = s_dist + 1;
+      uintE old = *a;
+      while (nd < old) {
+        if (cpam::utils::atomic_compare_and_swap(a, old, nd)) return true;
+        old = *a;
+      }
+      return false;
+    }
+    bool first_in_round(uintE d) {
+      uintE old = mark[d];
+      return old != round && cpam::utils::atomic_compare_and_swap(&mark[d], old, round);
+    }
+  };
+
+  void grow(size_t n) {
+    if (n <= dist.size()) return;
+    dist.append(parlay::sequence<uintE>(n - dist.size(), kInf));
+    mark.append(parlay::sequence<uintE>(n - mark.size(), 0));
+    invalid.append(parlay::sequence<bool>(n - invalid.size(), false));
+  }
+
+  static parlay::sequence<uintE> dedup(parlay::sequence<uintE>&& S) {
+    parlay::sort_inplace(S);
+    return parlay::unique(S);
+  }
+
+  // The targets of the m edges whose distance they lowered.
+  template <class Edge>
+  parlay::sequence<uintE> relax_edges(size_t m, Edge* edges) {
+    relax_F f{dist.begin(), mark.begin(), ++round};
+    auto lowered = parlay::tabulate(m, [&] (size_t i) {
+      uintE u = std::get<0>(edges[i]), v = std::get<1>(edges[i]);
+      return f.updateAtomic(u, v, W()) ? v : kInf;
+    });
+    return parlay::filter(lowered, [] (uintE v) { return v != kInf; });
+  }
+
+  // Pushes the distances of the seeds, which were lowered, along out-edges
+  // until no distance changes.
+  void propagate(Graph& G, parlay::sequence<uintE>&& seeds) {
+    size_t n = dist.size();
+    vertexSubset frontier(n, std::move(seeds));
+    while (!frontier.isEmpty()) {
+      frontier = G.edgeMap(frontier, relax_F{dist.begin(), mark.begin(), ++round},
+                           -1, sparse_blocked | dense_parallel);
+    }
+  }
+};
+
+}  // namespace aspen
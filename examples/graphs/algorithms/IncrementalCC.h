@@ -0,0 +1,338 @@
+#pragma once
+
+#include "aspen/aspen.h"
+
+#include <unordered_map>
+#include <unordered_set>
+
+namespace aspen {
+
+// Maintains the connected components of a symmetric graph across the
+// versions produced by batches of edge updates, given each batch and the
+// version it produced.
+//
+// The components are kept as a concurrent union-find forest (linking the
+// larger root under the smaller one), so an insertion batch only unites the
+// endpoints of its edges. A deletion can split a component: for each
+// deleted edge, a bounded bidirectional search in the new version either
+// reconnects its endpoints or runs out on one side, which is then a
+// component of its own. If a search hits its bound, the components holding
+// the deleted edges are recomputed instead, by resetting their vertices and
+// uniting them over their edges. Batches larger than recompute_fraction * m,
+// and recomputations of more than recompute_fraction * n vertices, fall
+// back to recomputing from scratch.
+//
+// The forest is over nodes rather than vertices: each vertex has a node, and
+// each root names a vertex of its component. A side that splits off moves to
+// fresh nodes, so the rest of its old component keeps its tree and is not
+// relabeled, and a deletion batch costs time in the sizes of its searches
+// rather than in n. The nodes left behind are compacted away once they
+// outnumber the vertices.
+template <class Graph>
+struct IncrementalCC {
+  using flat_snap_t = typename Graph::flat_snap_t;
+
+  explicit IncrementalCC(Graph& G, double recompute_fraction = 0.05)
+      : recompute_fraction(recompute_fraction) {
+    recompute(G);
+  }
+
+  size_t num_vertices() const { return node.size(); }
+
+  // The component id of v: a vertex of its component, the same for all of
+  // them.
+  uintE component(uintE v) { return label[find(node[v])]; }
+
+  parlay::sequence<uintE> labels() {
+    return parlay::tabulate(node.size(), [&] (size_t v) { return component(v); });
+  }
+
+  size_t num_components() {
+    auto ids = parlay::delayed_seq<size_t>(node.size(), [&] (size_t v) {
+      return (size_t)(component(v) == v); });
+    return parlay::reduce(ids);
+  }
+
+  void recompute(Graph& G) {
+    size_t n = G.num_vertices();
+    node = parlay::tabulate(n, [] (size_t i) { return (uintE)i; });
+    parents = node;
+    label = node;
+    split = parlay::sequence<uintE>(n, UINT_E_MAX);
+    auto map_f = [&] (const auto& vtx) {
+      auto unite_f = [&] (const uintE& v, const uintE& ngh, const auto& wgh) {
+        unite(node[v], node[ngh]);
+      };
+      vtx.out_neighbors().map(unite_f);
+    };
+    G.map_vertices(map_f);
+    recomputes++;
+  }
+
+  // G is the version produced by inserting the m edges.
+  template <class Edge>
+  void insert_edges(Graph& G, size_t m, Edge* edges) {
+    if (m > recompute_fraction * G.num_edges()) return recompute(G);
+    grow(G.num_vertices());
+    parlay::parallel_for(0, m, [&] (size_t i) {
+      unite(node[std::get<0>(edges[i])], node[std::get<1>(edges[i])]);
+    });
+  }
+
+  // G is the version produced by deleting the m edges. The optional flat
+  // snapshot of G speeds up fetching vertices.
+  template <class Edge>
+  void delete_edges(Graph& G, size_t m, Edge* edges,
+                    const flat_snap_t* snapshot = nullptr) {
+    if (m > recompute_fraction * G.num_edges()) return recompute(G);
+    grow(G.num_vertices());
+    size_t n = num_vertices();
+    auto get_vertex = [&] (uintE v) {
+      return (snapshot && v < snapshot->size())
+          ? typename Graph::vertex(v, (*snapshot)[v]) : G.get_vertex(v);
+    };
+
+    if (parents.size() > 2 * n) compact();
+
+    using edge = std::pair<uintE, uintE>;
+    auto E = parlay::filter(parlay::delayed_seq<edge>(m, [&] (size_t i) {
+      uintE u = std::get<0>(edges[i]), v = std::get<1>(edges[i]);
+      return edge(std::min(u, v), std::max(u, v));
+    }), [&] (const edge& e) { return e.first != e.second && e.second < n; });
+    parlay::sort_inplace(E);
+    E = parlay::unique(E);
+    if (E.size() == 0) return;
+
+    // The roots of the endpoints' components before the batch.
+    auto roots = parlay::map(E, [&] (const edge& e) {
+      return edge(find(node[e.first]), find(node[e.second])); });
+
+    size_t budget = std::max<size_t>(kMinSearchBudget,
+                                     recompute_fraction * n / E.size());
+    auto results = parlay::map(E, [&] (const edge& e) {
+      return search(get_vertex, e.first, e.second, budget); });
+    auto unknown = parlay::delayed_seq<bool>(E.size(), [&] (size_t i) {
+      return results[i].outcome == kUnknown; });
+    if (parlay::reduce(unknown, parlay::addm<size_t>()) > 0) {
+      return recompute_components(G, roots, get_vertex);
+    }
+
+    // A side that ran out is a whole component of G, labeled by its
+    // smallest vertex. The same component may be found by several edges;
+    // sides holds each one once, as (label, edge index).
+    auto found = parlay::map(parlay::filter(parlay::iota<uintE>(E.size()),
+        [&] (uintE i) { return results[i].outcome == kSplit; }),
+        [&] (uintE i) { return edge(*parlay::min_element(results[i].side), i); });
+    parlay::sort_inplace(found);
+    auto sides = parlay::filter(parlay::iota<size_t>(found.size()), [&] (size_t j) {
+      return j == 0 || found[j].first != found[j-1].first; });
+    auto side = [&] (size_t k) -> auto& { return results[found[sides[k]].second].side; };
+    auto for_side = [&] (auto f) {
+      parlay::parallel_for(0, sides.size(), [&] (size_t k) {
+        auto& S = side(k);
+        parlay::parallel_for(0, S.size(), [&] (size_t t) { f(k, S, t); });
+      }, 1);
+    };
+    for_side([&] (size_t k, auto& S, size_t t) { split[S[t]] = found[sides[k]].first; });
+    // split is scratch, all UINT_E_MAX between batches
+    auto clear_split = [&] {
+      for_side([&] (size_t k, auto& S, size_t t) { split[S[t]] = UINT_E_MAX; });
+    };
+
+    // The endpoints left in their old components must still be connected to
+    // each other there.
+    if (!anchors_connected(E, results, roots, budget, get_vertex)) {
+      clear_split();
+      return recompute_components(G, roots, get_vertex);
+    }
+
+    // A component whose label split off is labeled by one of its endpoints
+    // that did not.
+    for (size_t i = 0; i < E.size(); i++) {
+      for (auto [x, r] : {std::pair(E[i].first, roots[i].first),
+                          std::pair(E[i].second, roots[i].second)}) {
+        if (split[x] == UINT_E_MAX && split[label[r]] != UINT_E_MAX) label[r] = x;
+      }
+    }
+
+    // Each side moves to fresh nodes, rooted at its first one; the nodes it
+    // leaves stay in the old tree.
+    auto offsets = parlay::map(parlay::iota<size_t>(sides.size()), [&] (size_t k) {
+      return side(k).size(); });
+    size_t total = parlay::scan_inplace(offsets);
+    size_t first = parents.size();
+    parents.append(parlay::sequence<uintE>(total));
+    label.append(parlay::sequence<uintE>(total));
+    for_side([&] (size_t k, auto& S, size_t t) {
+      uintE root = first + offsets[k];
+      if (t == 0) label[root] = found[sides[k]].first;
+      node[S[t]] = root + t;
+      parents[root + t] = root;
+    });
+    clear_split();
+  }
+
+  // The number of times the components were recomputed from scratch.
+  size_t num_recomputes() const { return recomputes; }
+
+ private:
+  parlay::sequence<uintE> node;     // the node of each vertex
+  parlay::sequence<uintE> parents;  // of each node
+  parlay::sequence<uintE> label;    // of each root: a vertex of its component
+  parlay::sequence<uintE> split;    // scratch for delete_edges, all UINT_E_MAX
+  double recompute_fraction;
+  size_t recomputes = 0;
+
+  // Searches for whether a deleted edge split its component stop after
+  // visiting this many vertices (or recompute_fraction * n / #edges, if
+  // larger), after which the components are recomputed.
+  static constexpr size_t kMinSearchBudget = 1024;
+
+  enum search_outcome { kConnected, kSplit, kUnknown };
+  struct search_result {
+    search_outcome outcome;
+    parlay::sequence<uintE> side;  // the component found, for kSplit
+  };
+
+  // Bidirectional BFS between u and v, expanding the side that has visited
+  // fewer vertices, until the sides meet, one side runs out (it is then a
+  // whole component), or more than budget vertices were visited.
+  template <class GetVertex>
+  static search_result search(const GetVertex& get_vertex, uintE u, uintE v,
+                              size_t budget) {
+    std::unordered_set<uintE> seen[2] = {{u}, {v}};
+    std::vector<uintE> queue[2] = {{u}, {v}};
+    size_t head[2] = {0, 0};
+    while (seen[0].size() + seen[1].size() <= budget) {
+      for (int s = 0; s < 2; s++) {
+        if (head[s] == queue[s].size()) {
+          return {kSplit, parlay::sequence<uintE>(queue[s].begin(), queue[s].end())};
+        }
+      }
+      int s = (seen[0].size() <= seen[1].size()) ? 0 : 1;
+      bool met = false;
+      auto visit_f = [&] (const uintE& x, const uintE& ngh, const auto& wgh) {
+        if (seen[1 - s].count(ngh)) met = true;
+        else if (seen[s].insert(ngh).second) queue[s].push_back(ngh);
+        return !met;
+      };
+      get_vertex(queue[s][head[s]++]).out_neighbors().foreach_cond(visit_f);
+      if (met) return {kConnected, {}};
+    }
+    return {kUnknown, {}};
+  }
+
+  // Whether, in every old component, the endpoints of deleted edges that
+  // did not split off are connected to each other. Endpoints of edges found
+  // connected are grouped first; the groups of a component are then checked
+  // against its first one by further searches. roots holds the old roots of
+  // the endpoints of each edge.
+  template <class Seq, class Results, class GetVertex>
+  bool anchors_connected(const Seq& E, const Results& results, const Seq& roots,
+                         size_t budget, const GetVertex& get_vertex) {
+    std::unordered_map<uintE, uintE> group;
+    std::unordered_map<uintE, uintE> root_of;
+    auto find_group = [&] (uintE x) {
+      while (group[x] != x) x = group[x] = group[group[x]];
+      return x;
+    };
+    auto add = [&] (uintE x, uintE r) {
+      if (split[x] == UINT_E_MAX && !group.count(x)) {
+        group[x] = x;
+        root_of[x] = r;
+      }
+    };
+    for (size_t i = 0; i < E.size(); i++) {
+      add(E[i].first, roots[i].first);
+      add(E[i].second, roots[i].second);
+      if (results[i].outcome == kConnected) {
+        group[find_group(E[i].first)] = find_group(E[i].second);
+      }
+    }
+    // the first group of each old component, by its root
+    std::unordered_map<uintE, uintE> first;
+    std::vector<std::pair<uintE, uintE>> checks;
+    for (auto& [x, g] : group) {
+      if (find_group(x) != x) continue;
+      auto [it, added] = first.emplace(root_of[x], x);
+      if (!added) checks.emplace_back(it->second, x);
+    }
+    auto ok = parlay::tabulate(checks.size(), [&] (size_t i) {
+      return search(get_vertex, checks[i].first, checks[i].second, budget).outcome
+          == kConnected;
+    });
+    return parlay::count(ok, false) == 0;
+  }
+
+  // Recomputes the components of the vertices whose old components held
+  // the deleted edges, given by the old roots of their endpoints. Finding
+  // these vertices takes a pass over all of them.
+  template <class Seq, class GetVertex>
+  void recompute_components(Graph& G, const Seq& roots,
+                            const GetVertex& get_vertex) {
+    size_t n = num_vertices();
+    std::unordered_set<uintE> affected;
+    for (auto [r1, r2] : roots) affected.insert({r1, r2});
+    auto X = parlay::pack_index<uintE>(parlay::delayed_seq<bool>(n, [&] (size_t v) {
+      return affected.count(find(node[v])) > 0; }));
+    if (X.size() > recompute_fraction * n) return recompute(G);
+
+    parlay::parallel_for(0, X.size(), [&] (size_t i) {
+      uintE x = node[X[i]];
+      parents[x] = x;
+      label[x] = X[i];
+    });
+    parlay::parallel_for(0, X.size(), [&] (size_t i) {
+      auto unite_f = [&] (const uintE& v, const uintE& ngh, const auto& wgh) {
+        unite(node[v], node[ngh]);
+      };
+      get_vertex(X[i]).out_neighbors().map(unite_f);
+    }, 1);
+  }
+
+  // Vertices added by a batch start as singletons, on fresh nodes.
+  void grow(size_t n) {
+    size_t old_n = node.size();
+    if (n <= old_n) return;
+    size_t first = parents.size();
+    node.append(parlay::tabulate(n - old_n, [&] (size_t i) {
+      return (uintE)(first + i); }));
+    parents.append(parlay::tabulate(n - old_n, [&] (size_t i) {
+      return (uintE)(first + i); }));
+    label.append(parlay::tabulate(n - old_n, [&] (size_t i) {
+      return (uintE)(old_n + i); }));
+    split.append(parlay::sequence<uintE>(n - old_n, UINT_E_MAX));
+  }
+
+  // Drops the nodes that no vertex uses: each vertex goes back to its own
+  // node, pointing at the label of its component.
+  void compact() {
+    auto ids = labels();
+    parents = std::move(ids);
+    node = parlay::tabulate(node.size(), [] (size_t i) { return (uintE)i; });
+    label = node;
+  }
+
+  // Path splitting: every node on the path is moved to its grandparent.
+  uintE find(uintE x) {
+    while (true) {
+      uintE p = parents[x];
+      if (p == x) return x;
+      uintE gp = parents[p];
+      if (p != gp) cpam::utils::atomic_compare_and_swap(&parents[x], p, gp);
+      x = p;
+    }
+  }
+
+  void unite(uintE u, uintE v) {
+    while (true) {
+      u = find(u);
+      v = find(v);
+      if (u == v) return;
+      if (u < v) std::swap(u, v);
+      if (cpam::utils::atomic_compare_and_swap(&parents[u], u, v)) return;
+    }
+  }
+};
+
+}  // namespace aspen
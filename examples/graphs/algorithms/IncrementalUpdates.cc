@@ -0,0 +1,144 @@
+// Usage:
+// numactl -i all ./IncrementalUpdates -src 10012 -bs 10000 -batches 10 -s twitter_SJ
+// flags:
+//   optional:
+//     -src: the source of the maintained BFS
+//     -bs: the number of rMAT edges in each batch
+//     -batches: the number of insert/delete batch pairs
+//     -fraction: the recompute_fraction of the incremental algorithms
+//     -flatsnap: pass a flat snapshot of each version to delete_edges
+//     -rounds : the number of times to run the algorithm
+//     -c : indicate that the graph is compressed
+//     -m : indicate that the graph should be mmap'd
+//     -s : indicate that the graph is symmetric
+//     -d : read the graph as directed; components are then not maintained
+//
+// Streams batches of rMAT edges into the graph, each one followed by a
+// batch deleting the same edges (so edges of the input are deleted too),
+// and maintains BFS distances (and components, on symmetric graphs) across
+// them. After every batch the result is checked against recomputing from
+// scratch on the new version; the process exits with an error on a
+// mismatch.
+
+#include "IncrementalBFS.h"
+#include "IncrementalCC.h"
+#include "aspen/aspen.h"
+#include "run_batch_updates/pbbsrandom.h"
+#include "run_batch_updates/rmat_util.h"
+
+#include <cpam/parse_command_line.h>
+
+#include <optional>
+#include <unordered_map>
+
+namespace aspen {
+
+// Whether a and b assign the same vertices to the same components.
+inline bool same_partition(const parlay::sequence<uintE>& a,
+                           const parlay::sequence<uintE>& b) {
+  if (a.size() != b.size()) return false;
+  std::unordered_map<uintE, uintE> a_to_b, b_to_a;
+  for (size_t v = 0; v < a.size(); v++) {
+    if (a_to_b.emplace(a[v], b[v]).first->second != b[v]) return false;
+    if (b_to_a.emplace(b[v], a[v]).first->second != a[v]) return false;
+  }
+  return true;
+}
+
+template <class Graph>
+double IncrementalUpdates_runner(Graph& G, cpam::commandLine P) {
+  uintE src = static_cast<uintE>(P.getOptionLongValue("-src", 0));
+  size_t batch_size = P.getOptionLongValue("-bs", 1000);
+  size_t num_batches = P.getOptionLongValue("-batches", 10);
+  double fraction = P.getOptionDoubleValue("-fraction", 0.05);
+  bool flatsnap = P.getOptionValue("-flatsnap");
+  std::cout << "### Application: IncrementalUpdates" << std::endl;
+  std::cout << "### Graph: " << P.getArgument(0) << std::endl;
+  std::cout << "### Threads: " << parlay::num_workers() << std::endl;
+  std::cout << "### n: " << G.num_vertices() << std::endl;
+  std::cout << "### m: " << G.num_edges() << std::endl;
+  std::cout << "### Params: -src = " << src << " -bs = " << batch_size
+            << " -batches = " << num_batches << " -fraction = " << fraction
+            << " flatsnap = " << flatsnap
+            << " directed = " << Graph::is_directed << std::endl;
+  std::cout << "### ------------------------------------" << std::endl;
+  std::cout << "### ------------------------------------" << std::endl;
+
+  using pair_vertex = std::tuple<uintE, uintE>;
+  size_t n = G.num_vertices();
+  size_t nn = 1 << (parlay::log2_up(n) - 1);
+  pbbs::random r;
+
+  Graph H = G;
+  IncrementalBFS<Graph> bfs(H, src, fraction);
+  std::optional<IncrementalCC<Graph>> cc;
+  if constexpr (!Graph::is_directed) cc.emplace(H, fraction);
+
+  // Updates the maintained results to the version H2 produced by the batch,
+  // and checks them against recomputing on H2.
+  double update_time = 0.0;
+  auto apply = [&] (Graph& H2, parlay::sequence<pair_vertex>& batch, bool del) {
+    std::optional<typename Graph::flat_snap_t> fs;
+    if (del && flatsnap) fs = H2.fetch_all_vertices();
+    timer t; t.start();
+    if (del) {
+      bfs.delete_edges(H2, batch.size(), batch.begin(), fs ? &*fs : nullptr);
+      if (cc) cc->delete_edges(H2, batch.size(), batch.begin(), fs ? &*fs : nullptr);
+    } else {
+      bfs.insert_edges(H2, batch.size(), batch.begin());
+      if (cc) cc->insert_edges(H2, batch.size(), batch.begin());
+    }
+    update_time += t.stop();
+
+    IncrementalBFS<Graph> bfs_check(H2, src);
+    auto mismatched = parlay::count_if(parlay::iota<uintE>(H2.num_vertices()),
+        [&] (uintE v) { return bfs.distance(v) != bfs_check.distance(v); });
+    if (mismatched > 0) {
+      std::cout << "# BFS distances differ from a recomputation at "
+                << mismatched << " vertices" << std::endl;
+      exit(-1);
+    }
+    if (cc) {
+      IncrementalCC<Graph> cc_check(H2);
+      if (!same_partition(cc->labels(), cc_check.labels())) {
+        std::cout << "# Components differ from a recomputation" << std::endl;
+        exit(-1);
+      }
+    }
+  };
+
+  for (size_t b = 0; b < num_batches; b++) {
+    auto rmat = rMat<uintE>(nn, r.ith_rand(b), 0.5, 0.1, 0.1);
+    auto updates = parlay::tabulate(batch_size, [&] (size_t i) {
+      auto [u, v] = rmat(i);
+      return pair_vertex(u, v);
+    });
+    if constexpr (!Graph::is_directed) {
+      updates.append(parlay::map(updates, [] (const pair_vertex& e) {
+        return pair_vertex(std::get<1>(e), std::get<0>(e)); }));
+    }
+
+    // The graph may reorder the batch it is given.
+    auto edges = updates;
+    Graph H2 = H.insert_edges_batch(edges.size(), edges.begin(), false, true);
+    apply(H2, updates, false);
+    H = std::move(H2);
+
+    edges = updates;
+    H2 = H.delete_edges_batch(edges.size(), edges.begin(), false, true);
+    apply(H2, updates, true);
+    H = std::move(H2);
+  }
+
+  std::cout << "### Update Time: " << update_time << std::endl;
+  std::cout << "### BFS recomputes: " << bfs.num_recomputes() << std::endl;
+  if (cc) {
+    std::cout << "### CC recomputes: " << cc->num_recomputes() << std::endl;
+  }
+  std::cout << "### Checked " << 2 * num_batches << " batches" << std::endl;
+  return update_time;
+}
+
+}  // namespace aspen
+
+generate_aspen_main(aspen::IncrementalUpdates_runner, false);
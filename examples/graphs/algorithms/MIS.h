@@ -121,18 +121,20 @@ struct mis_f {
 };
 
 template <class Graph>
-inline parlay::sequence<bool> MaximalIndependentSet(Graph& G, bool flatsnap=false) {
+inline parlay::sequence<bool> MaximalIndependentSet(Graph& G, bool flatsnap=false,
+    const typename Graph::flat_snap_t* snapshot=nullptr) {
   using W = typename Graph::weight_type;
   timer init_t; init_t.start();
   size_t n = G.num_vertices();
-  using edge_node = typename Graph::edge_node;
-  parlay::sequence<edge_node*> fs;
-  if (flatsnap) {
+  using flat_snap_t = typename Graph::flat_snap_t;
+  flat_snap_t own_fs;
+  if (flatsnap && !snapshot) {
     timer st;
     st.start();
-    fs = G.fetch_all_vertices();
+    own_fs = G.fetch_all_vertices();
     st.next("Snapshot time");
   }
+  const flat_snap_t& fs = snapshot ? *snapshot : own_fs;
 
   // compute the priority DAG
   auto priorities = parlay::sequence<intE>::uninitialized(n);
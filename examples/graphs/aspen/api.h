@@ -2,6 +2,7 @@
 
 #include "byte-pd-amortized.h"
 #include "graph_io.h"
+#include "directed_graph.h"
 #include "immutable_graph.h"
 #include "traversable_graph.h"
 #include "utils.h"
@@ -24,6 +25,22 @@ inline auto symmetric_graph_from_static_graph(
   return G;
 }
 
+// The adjacency lists of the static graph are read as out-edges; the
+// in-edges are derived from them.
+inline auto directed_graph_from_static_graph(
+    std::tuple<size_t, size_t, uintT*, uintE*>& parsed_graph) {
+  using W = empty;
+  using inner_graph = directed_graph<W>;
+  using outer_graph = traversable_graph<inner_graph>;
+  timer build_t;
+  build_t.start();
+  auto G = outer_graph(parsed_graph);
+  build_t.stop();
+  build_t.reportTotal("Aspen: build time");
+
+  return G;
+}
+
 inline auto symmetric_graph_from_static_compressed_graph(char* parsed_graph,
                                                          size_t n_parts = 20) {
   using W = empty;
@@ -232,6 +249,113 @@ inline auto symmetric_graph_from_static_compressed_graph_edges(
   return G;
 }
 
+// Builds the edge tree of vertex v straight from its byte-PD adjacency list
+// (degree edges at base). Neighbors are decoded into a buffer of kChunk
+// entries whose contents are encoded into leaf blocks and joined to the tree
+// built so far, so no uncompressed copy of the list is made. Lists longer
+// than kBlocksPerTask byte-PD blocks are split at block boundaries and their
+// pieces built in parallel. Self-loops and repeated neighbors are dropped.
+template <class edge_tree>
+typename edge_tree::node* edge_tree_from_bytepd(uchar* base, uintE degree,
+                                                uintE v) {
+  using Tree = typename edge_tree::Tree;
+  using node = typename edge_tree::node;
+  using E = typename edge_tree::E;
+  using V = typename edge_tree::V;
+  constexpr size_t B = edge_tree::B;
+  constexpr size_t kChunk = 16*B;
+  constexpr size_t kBlocksPerTask = 16;
+
+  auto chunk_tree = [&](E* A, size_t k) -> node* {
+    if (k <= 2*B) return Tree::make_single_compressed_node(A, k);
+    return Tree::from_array(A, k);
+  };
+
+  // the tree of the neighbors in byte-PD blocks [lo, hi)
+  auto build = [&](size_t lo, size_t hi) -> node* {
+    E buf[kChunk];
+    size_t k = 0;
+    node* t = nullptr;
+    // the last neighbor before block lo, to drop repeats across pieces
+    bool has_prev = false;
+    uintE prev = 0;
+    for (size_t b = lo; b-- > 0 && !has_prev;) {
+      bytepd_amortized::decode_block(base, degree, v, b, [&](uintE ngh) {
+        prev = ngh; has_prev = true; });
+    }
+    for (size_t b = lo; b < hi; b++) {
+      bytepd_amortized::decode_block(base, degree, v, b, [&](uintE ngh) {
+        if (ngh != v && !(has_prev && ngh == prev)) {
+          buf[k++] = E(ngh, V());
+          if (k == kChunk) {
+            t = Tree::join2(t, chunk_tree(buf, k));
+            k = 0;
+          }
+        }
+        prev = ngh; has_prev = true;
+      });
+    }
+    if (k > 0) t = Tree::join2(t, chunk_tree(buf, k));
+    return t;
+  };
+
+  size_t nb = bytepd_amortized::num_blocks(base, degree);
+  size_t tasks = (nb + kBlocksPerTask - 1) / kBlocksPerTask;
+  if (tasks <= 1) return build(0, nb);
+  auto pieces = parlay::tabulate(tasks, [&] (size_t i) {
+    return build(i*kBlocksPerTask, std::min(nb, (i+1)*kBlocksPerTask)); }, 1);
+  node* t = nullptr;
+  for (size_t i = 0; i < tasks; i++) t = Tree::join2(t, pieces[i]);
+  return t;
+}
+
+// Builds the graph from a byte-PD compressed graph in one parallel pass over
+// the vertices, transcoding each adjacency list directly into leaf blocks
+// with edge_tree_from_bytepd. Besides the graph itself, it only allocates
+// O(n) space for the vertex entries.
+inline auto symmetric_graph_from_static_compressed_graph_direct(
+    char* parsed_graph) {
+  using W = empty;
+  using inner_graph = symmetric_graph<W>;
+  using outer_graph = traversable_graph<inner_graph>;
+  using edge_tree = typename inner_graph::edge_tree;
+  using vertex_tree = typename inner_graph::vertex_tree;
+  using VE = typename vertex_tree::E;
+
+  char* s = parsed_graph;
+  long* sizes = (long*)s;
+  size_t n = sizes[0];
+  cout << "sz[0] = " << sizes[0] << " sz[1] = " << sizes[1]
+       << " sz[2] = " << sizes[2] << endl;
+  uintT* offsets = (uintT*)(s + 3 * sizeof(long));
+  long skip = 3 * sizeof(long) + (n + 1) * sizeof(uintT);
+  uintE* Degrees = (uintE*)(s + skip);
+  skip += n * sizeof(uintE);
+  uchar* edges = (uchar*)(s + skip);
+
+  timer build_t;
+  build_t.start();
+
+  auto verts = parlay::tabulate(n, [&] (size_t i) {
+    uintE v = i;
+    auto t = (Degrees[v] > 0) ?
+        edge_tree_from_bytepd<edge_tree>(edges + offsets[v], Degrees[v], v) : nullptr;
+    return VE(v, t);
+  }, 1);
+  auto nonempty = parlay::filter(verts, [] (const VE& e) {
+    return std::get<1>(e) != nullptr; });
+  verts.clear();
+  outer_graph G(vertex_tree::from_sorted(nonempty));
+  build_t.stop();
+  build_t.reportTotal("Aspen: build time");
+
+  std::cout << "Finished construction" << std::endl;
+  std::cout << "G.n = " << G.num_vertices() << " G.m = " << G.num_edges()
+            << std::endl;
+
+  return G;
+}
+
 }  // namespace aspen
 
 #define run_app(G, APP, rounds)             \
@@ -268,7 +392,7 @@ inline auto symmetric_graph_from_static_compressed_graph_edges(
       auto G =                                                                \
           aspen::parse_unweighted_compressed_symmetric_graph(iFile, mmap);    \
       rt.next("Graph read time");                                             \
-      auto AG = aspen::symmetric_graph_from_static_compressed_graph_edges(G); \
+      auto AG = aspen::symmetric_graph_from_static_compressed_graph_direct(G); \
       run_app(AG, APP, rounds)                                                \
     } else {                                                                  \
       auto G = aspen::parse_unweighted_symmetric_graph(iFile, mmap);          \
@@ -277,3 +401,51 @@ inline auto symmetric_graph_from_static_compressed_graph_edges(
       run_app(AG, APP, rounds)                                                \
     }                                                                         \
   }
+
+/* Macro to generate binary for unweighted graph applications that can also
+ * run on directed graphs: with -d, the adjacency lists of the input are read
+ * as out-edges of a directed graph */
+#define generate_aspen_main(APP, mutates)                                     \
+  int main(int argc, char* argv[]) {                                          \
+    std::cout << "In main" << std::endl;                                      \
+    cpam::commandLine P(argc, argv, " [-s | -d] <inFile>");                   \
+    char* iFile = P.getArgument(0);                                           \
+    bool directed = P.getOptionValue("-d");                                   \
+    bool mmap = P.getOptionValue("-m");                                       \
+    size_t rounds = P.getOptionLongValue("-rounds", 3);                       \
+    if (!directed) {                                                          \
+      bool symmetric = P.getOptionValue("-s");                                \
+      if (!symmetric) {                                                       \
+        std::cout << "# The input is read as a symmetric graph; use -d for "  \
+                     "a directed one."                                        \
+                  << std::endl;                                               \
+      }                                                                       \
+      timer rt;                                                               \
+      rt.start();                                                             \
+      if (P.getOption("-c")) {                                                \
+        auto G =                                                              \
+            aspen::parse_unweighted_compressed_symmetric_graph(iFile, mmap);  \
+        rt.next("Graph read time");                                           \
+        auto AG =                                                             \
+            aspen::symmetric_graph_from_static_compressed_graph_direct(G);    \
+        run_app(AG, APP, rounds)                                              \
+      } else {                                                                \
+        auto G = aspen::parse_unweighted_symmetric_graph(iFile, mmap);        \
+        rt.next("Graph read time");                                           \
+        auto AG = aspen::symmetric_graph_from_static_graph(G);                \
+        run_app(AG, APP, rounds)                                              \
+      }                                                                       \
+    } else {                                                                  \
+      if (P.getOption("-c")) {                                                \
+        std::cout << "# Compressed inputs are only read as symmetric graphs." \
+                  << std::endl;                                               \
+        exit(-1);                                                             \
+      }                                                                       \
+      timer rt;                                                               \
+      rt.start();                                                             \
+      auto G = aspen::parse_unweighted_symmetric_graph(iFile, mmap);          \
+      rt.next("Graph read time");                                             \
+      auto AG = aspen::directed_graph_from_static_graph(G);                   \
+      run_app(AG, APP, rounds)                                                \
+    }                                                                         \
+  }
@@ -5,6 +5,7 @@
 #include "utils.h"
 #include "build.h"
 #include "immutable_graph.h"
+#include "directed_graph.h"
 #include "traversable_graph.h"
 #include "versioned_graph.h"
 #include "api.h"
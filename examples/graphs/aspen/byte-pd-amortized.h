@@ -56,6 +56,37 @@ namespace bytepd_amortized {
     return edgeRead;
   }
 
+  // The number of blocks (of up to PARALLEL_DEGREE edges) in the adjacency
+  // list at base. Each block is preceded by the index of its first edge and
+  // the lists of all but the first block start at the offsets stored after
+  // the virtual degree, so blocks can be decoded independently.
+  inline size_t num_blocks(uchar* base, uintE degree) {
+    if (degree == 0) return 0;
+    uintE virtual_degree = *((uintE*)base);
+    return 1 + (virtual_degree - 1) / PARALLEL_DEGREE;
+  }
+
+  // Applies f, in order, to the neighbors of src in block i of the adjacency
+  // list at base.
+  template <class F>
+  inline void decode_block(uchar* base, uintE degree, uintE src, size_t i,
+                           const F& f) {
+    size_t nb = num_blocks(base, degree);
+    uintE* block_offsets = (uintE*)(base + sizeof(uintE));
+    uchar* finger = (i == 0) ? base + nb*sizeof(uintE) : base + block_offsets[i-1];
+    uintE start_offset = *((uintE*)finger);
+    uintE end_offset = (i == nb - 1) ? degree : *((uintE*)(base + block_offsets[i]));
+    finger += sizeof(uintE);
+    if (start_offset < end_offset) {
+      uintE ngh = eatFirstEdge(finger, src);
+      f(ngh);
+      for (size_t j = start_offset + 1; j < end_offset; j++) {
+        ngh += eatEdge(finger);
+        f(ngh);
+      }
+    }
+  }
+
   struct simple_iter {
     uchar* base;
     uchar* finger;
@@ -0,0 +1,367 @@
+#pragma once
+
+#include "immutable_graph.h"
+
+namespace aspen {
+
+// A directed graph: every vertex has a tree of its out-neighbors and a tree
+// of its in-neighbors, so that traversals can pull over in-edges as well as
+// push over out-edges. An edge (u, v) is stored as v in the out-edge tree of
+// u and as u in the in-edge tree of v; batch updates maintain both with a
+// single pass over the vertex tree. The edge trees are the same as in
+// symmetric_graph.
+template <class weight>
+struct directed_graph {
+  using SymGraph = symmetric_graph<weight>;
+  using edge_entry = typename SymGraph::edge_entry;
+  using edge_tree = typename SymGraph::edge_tree;
+  using edge_node = typename edge_tree::node;
+  using ngh_and_weight = typename SymGraph::ngh_and_weight;
+  using neighbors = typename SymGraph::neighbors;
+
+  // The value of a vertex in the vertex tree.
+  struct vertex_data {
+    edge_node* in;
+    edge_node* out;
+    bool operator == (const vertex_data& d) const {
+      return in == d.in && out == d.out;
+    }
+  };
+  static constexpr bool is_directed = true;
+
+  struct vertex_entry {
+    using key_t = vertex_id;
+    using val_t = vertex_data;
+    using aug_t = std::pair<vertex_id, edge_id>;  // max id, #edges
+    static inline bool comp(key_t a, key_t b) { return a < b; }
+    static aug_t get_empty() { return std::make_pair(0, 0); }
+    static aug_t from_entry(const key_t& k, const val_t& v) {
+      return std::make_pair(k, edge_tree::Tree::size(v.out));
+    }
+    static aug_t combine(aug_t a, aug_t b) {
+      auto& [a_v, a_e] = a;
+      auto& [b_v, b_e] = b;
+      return {std::max(a_v, b_v), a_e + b_e};
+    }
+    using entry_t = std::tuple<key_t, val_t>;
+  };
+#ifdef USE_DIFF_ENCODING
+  using vertex_tree = cpam::diff_encoded_aug_map<vertex_entry, 64>;
+#else
+  using vertex_tree = cpam::aug_map<vertex_entry>;
+#endif
+  using vertex_node = typename vertex_tree::node;
+  using vertex_gc = typename vertex_tree::GC;
+
+  struct vertex {
+    vertex_id id;
+    vertex_data edges;
+    vertex_data data() const { return edges; }
+    size_t out_degree() { return edge_tree::size(edges.out); }
+    size_t in_degree() { return edge_tree::size(edges.in); }
+    auto out_neighbors() const { return neighbors(id, edges.out); }
+    auto in_neighbors() const { return neighbors(id, edges.in); }
+    vertex(vertex_id id, vertex_data edges) : id(id), edges(edges) {}
+    vertex() : id(std::numeric_limits<vertex_id>::max()),
+               edges{nullptr, nullptr} {}
+  };
+
+  using weight_type = weight;
+  using DirGraph = directed_graph<weight>;
+
+  vertex_tree V;
+
+  // Build from a static graph, reading its adjacency lists as out-edges.
+  directed_graph(std::tuple<size_t, size_t, uintT*, uintE*>& parsed_graph) {
+    size_t n = std::get<0>(parsed_graph), m = std::get<1>(parsed_graph);
+    uintT* offsets = std::get<2>(parsed_graph);
+    uintE* E = std::get<3>(parsed_graph);
+    reserve(n, 2 * m);
+    auto edges = parlay::sequence<std::pair<vertex_id, vertex_id>>::uninitialized(m);
+    parlay::parallel_for(0, n, [&] (size_t i) {
+      parlay::parallel_for(offsets[i], offsets[i+1], [&] (size_t j) {
+        edges[j] = std::make_pair(i, E[j]);
+      });
+    }, 1);
+    V.root = nullptr;
+    insert_edges_batch_3(m, edges.begin(), false, true);
+  }
+
+  // Set from a provided root (no ref-ct bump)
+  directed_graph(vertex_node* root) { set_root(root); }
+
+  directed_graph(vertex_tree&& _V) : V(std::move(_V)) {}
+
+  directed_graph() { V.root = nullptr; }
+
+  vertex_tree& get_vertices() { return V; }
+
+  void clear_root() { V.root = nullptr; }
+
+  vertex_node* get_root() { return V.root; }
+
+  size_t ref_cnt() { return V.ref_cnt(); }
+
+  void set_root(vertex_node* root) { V.root = root; }
+
+  size_t num_vertices() const { return V.aug_val().first + 1; }
+
+  size_t num_edges() const { return V.aug_val().second; }
+
+  vertex get_vertex(vertex_id v) const {
+    auto opt = V.find(v);
+    if (opt.has_value()) return vertex(v, *opt);
+    return vertex(v, vertex_data{nullptr, nullptr});
+  }
+
+  template <class F>
+  void map_vertices(const F& f) {
+    using entry_t = typename vertex_entry::entry_t;
+    auto map_f = [&](const entry_t& vtx_entry, size_t i) {
+      auto vtx = vertex(std::get<0>(vtx_entry), std::get<1>(vtx_entry));
+      f(vtx);
+    };
+    vertex_tree::foreach_index(V, map_f, 0, 1);
+  }
+
+  template <class Func>
+  void iterate_seq(const Func& f) {
+    V.iterate_seq(f);
+  }
+
+  // Reserve space for n vertices and m edge tree entries.
+  static void reserve(size_t n, size_t m) {
+    vertex_tree::reserve(n);
+    edge_tree::reserve(m);
+  }
+
+  void get_tree_sizes(const std::string& graphname, const std::string& mode) {
+    auto noop = [](const auto& q) { return 0; };
+    size_t vertex_tree_bytes = V.size_in_bytes(noop);
+    auto tree_bytes = [&] (edge_node* root) -> size_t {
+      if (root == nullptr) return 0;
+      edge_tree tree;
+      tree.root = root;
+      size_t sz = tree.size_in_bytes(noop);
+      tree.root = nullptr;
+      return sz;
+    };
+    auto map_f = [&](const auto& et) -> size_t {
+      const vertex_data& d = std::get<1>(et);
+      return tree_bytes(d.in) + tree_bytes(d.out);
+    };
+    size_t edge_tree_bytes =
+        vertex_tree::map_reduce(V, map_f, typename neighbors::template Add<size_t>());
+
+    std::cout << "Edge trees size in bytes = " << edge_tree_bytes << std::endl;
+    std::cout << "Vertex tree size in bytes = " << vertex_tree_bytes
+              << std::endl;
+    size_t total_bytes = edge_tree_bytes + vertex_tree_bytes;
+    std::cout << "csv: " << graphname << "," << num_vertices() << "," << num_edges() << "," << mode
+              << "," << total_bytes << "," << vertex_tree_bytes << ","
+              << edge_tree_bytes << std::endl;
+  }
+
+  void print_stats() {
+    auto map_f = [&](const auto& et) -> size_t {
+      return edge_tree::size(std::get<1>(et).in);
+    };
+    size_t in_edges =
+        vertex_tree::map_reduce(V, map_f, typename neighbors::template Add<size_t>());
+    std::cout << "num_edges = " << num_edges() << std::endl;
+    std::cout << "num_in_edges = " << in_edges << std::endl;
+  }
+
+  /* ============= Update Operations ================ */
+
+  // A batch of m edges (u, v), grouped by the vertices they touch: for each
+  // such vertex w, in ascending order, the slices of vals holding the sorted
+  // in-neighbors (the u of edges (u, w)) and out-neighbors (the v of edges
+  // (w, v)) to update, built with make_val(neighbor). One sort orders both
+  // sides, keyed by (w, side, neighbor).
+  template <class Val>
+  struct update_groups {
+    using value_type = std::pair<parlay::slice<Val*, Val*>,
+                                 parlay::slice<Val*, Val*>>;
+    using KV = std::pair<vertex_id, value_type>;
+    parlay::sequence<Val> vals;
+    parlay::sequence<KV> elts;
+  };
+
+  template <class Val, class Edge, class MakeVal>
+  static update_groups<Val> group_updates(size_t m, Edge* edges,
+                                          bool remove_dups,
+                                          const MakeVal& make_val) {
+    timer t("Group", false);
+    // (w, side, neighbor), with side 0 for in-edges and 1 for out-edges
+    using update = std::tuple<vertex_id, uint8_t, vertex_id>;
+    auto U = parlay::sequence<update>::from_function(2 * m, [&] (size_t i) {
+      const auto& e = edges[i >> 1];
+      vertex_id u = std::get<0>(e), v = std::get<1>(e);
+      return (i & 1) ? update(u, 1, v) : update(v, 0, u);
+    });
+    auto ids = parlay::delayed_seq<size_t>(m, [&] (size_t i) {
+      return std::max<size_t>(std::get<0>(edges[i]), std::get<1>(edges[i]));
+    });
+    size_t vtx_bits = parlay::log2_up(parlay::reduce(ids, parlay::maxm<size_t>()) + 2);
+    if (2 * vtx_bits + 1 <= 64 && (size_t{1} << vtx_bits) <= U.size() * parlay::log2_up(U.size())) {
+      parlay::integer_sort_inplace(parlay::make_slice(U), [vtx_bits] (const update& x) -> size_t {
+        return (static_cast<size_t>(std::get<0>(x)) << (vtx_bits + 1)) |
+               (static_cast<size_t>(std::get<1>(x)) << vtx_bits) |
+               static_cast<size_t>(std::get<2>(x));
+      });
+    } else {
+      parlay::sort_inplace(parlay::make_slice(U), std::less<update>());
+    }
+    t.next("group: sort time");
+
+    if (remove_dups) {
+      U = parlay::pack(U, parlay::delayed_seq<bool>(U.size(), [&] (size_t i) {
+        return i == 0 || U[i] != U[i - 1];
+      }));
+    }
+    size_t k = U.size();
+
+    update_groups<Val> G;
+    G.vals = parlay::tabulate(k, [&] (size_t i) -> Val {
+      return make_val(std::get<2>(U[i]));
+    });
+    auto I = parlay::pack_index<size_t>(parlay::delayed_seq<bool>(k, [&] (size_t i) {
+      return i == 0 || std::get<0>(U[i]) != std::get<0>(U[i - 1]);
+    }));
+    using KV = typename update_groups<Val>::KV;
+    G.elts = parlay::sequence<KV>::from_function(I.size(), [&] (size_t i) {
+      size_t start = I[i];
+      size_t end = (i == I.size() - 1) ? k : I[i + 1];
+      size_t mid = std::partition_point(U.begin() + start, U.begin() + end,
+          [] (const update& x) { return std::get<1>(x) == 0; }) - U.begin();
+      Val* vals = G.vals.begin();
+      return KV(std::get<0>(U[start]),
+                {parlay::make_slice(vals + start, vals + mid),
+                 parlay::make_slice(vals + mid, vals + end)});
+    });
+    t.next("group: generate KV-pairs");
+    return G;
+  }
+
+  static edge_node* build_tree(parlay::slice<ngh_and_weight*, ngh_and_weight*> incoming) {
+    if (incoming.size() == 0) return nullptr;
+    auto tree = edge_tree(incoming.begin(), incoming.end());
+    auto root = tree.root;
+    tree.root = nullptr;
+    assert(edge_tree::Tree::ref_cnt(root) == 1);
+    return root;
+  }
+
+  // Inserts incoming into the tree rooted at cur. The result replaces cur
+  // in-place if inplace, and is a new version otherwise. An empty batch
+  // leaves the tree (shared with the previous version) as it is.
+  static edge_node* insert_into(edge_node* cur,
+                                parlay::slice<ngh_and_weight*, ngh_and_weight*> incoming,
+                                bool inplace) {
+    if (incoming.size() == 0) return cur;
+    if (cur == nullptr) return build_tree(incoming);
+    auto replace = [&] (const auto& a, const auto& b) { return b; };
+    edge_tree t;
+    t.root = cur;
+    auto ret = inplace ? edge_tree::multi_insert_sorted(std::move(t), incoming, replace)
+                       : edge_tree::multi_insert_sorted(t, incoming, replace);
+    t.root = nullptr;
+    auto r = ret.root;
+    ret.root = nullptr;
+    return r;
+  }
+
+  static edge_node* delete_from(edge_node* cur, parlay::slice<uintE*, uintE*> incoming,
+                                bool inplace) {
+    if (incoming.size() == 0 || cur == nullptr) return cur;
+    edge_tree t;
+    t.root = cur;
+    auto ret = inplace ? edge_tree::multi_delete_sorted(std::move(t), incoming)
+                       : edge_tree::multi_delete_sorted(t, incoming);
+    t.root = nullptr;
+    auto r = ret.root;
+    ret.root = nullptr;
+    return r;
+  }
+
+  template <class Edge>
+  vertex_tree insert_edges(size_t m, Edge* edges, bool remove_dups, bool inplace) {
+    timer t("Insert", false);
+    auto G = group_updates<ngh_and_weight>(m, edges, remove_dups, [] (vertex_id ngh) {
+      return ngh_and_weight(ngh, weight());
+    });
+    using value_type = typename update_groups<ngh_and_weight>::value_type;
+    auto combine_op = [&] (vertex_data cur, value_type incoming) {
+      return vertex_data{insert_into(cur.in, incoming.first, inplace),
+                         insert_into(cur.out, incoming.second, inplace)};
+    };
+    auto map_op = [] (value_type incoming) {
+      return vertex_data{build_tree(incoming.first), build_tree(incoming.second)};
+    };
+    auto new_V = inplace
+        ? vertex_tree::multi_insert_sorted_map(std::move(V), G.elts, combine_op, map_op)
+        : vertex_tree::multi_insert_sorted_map(V, G.elts, combine_op, map_op);
+    t.next("insert: multiinsert time");
+    return new_V;
+  }
+
+  template <class Edge>
+  vertex_tree delete_edges(size_t m, Edge* edges, bool remove_dups, bool inplace) {
+    timer t("Delete", false);
+    auto G = group_updates<uintE>(m, edges, remove_dups, [] (vertex_id ngh) {
+      return static_cast<uintE>(ngh);
+    });
+    using value_type = typename update_groups<uintE>::value_type;
+    auto combine_op = [&] (vertex_data cur, value_type incoming) {
+      return vertex_data{delete_from(cur.in, incoming.first, inplace),
+                         delete_from(cur.out, incoming.second, inplace)};
+    };
+    auto new_V = inplace
+        ? vertex_tree::multi_delete_sorted_map(std::move(V), G.elts, combine_op)
+        : vertex_tree::multi_delete_sorted_map(V, G.elts, combine_op);
+    t.next("delete: multidelete time");
+    return new_V;
+  }
+
+  // m : number of edges
+  // edges: the directed edges (u, v) to insert. Unlike symmetric_graph, the
+  // reverse edges are not needed: (u, v) adds v to the out-edges of u and u
+  // to the in-edges of v. The edges are not modified; sorted is ignored.
+  template <class Edge>
+  DirGraph insert_edges_batch_2(size_t m, Edge* edges,
+                                bool sorted = false, bool remove_dups = false,
+                                size_t nn = std::numeric_limits<size_t>::max(),
+                                bool run_seq = false) {
+    return DirGraph(insert_edges(m, edges, remove_dups, false));
+  }
+
+  template <class Edge>
+  void insert_edges_batch_3(size_t m, Edge* edges,
+                            bool sorted = false, bool remove_dups = false,
+                            size_t nn = std::numeric_limits<size_t>::max(),
+                            bool run_seq = false) {
+    V = insert_edges(m, edges, remove_dups, true);
+  }
+
+  // m : number of edges
+  // edges: the directed edges (u, v) to delete. Vertices left without edges
+  // stay in the vertex tree, as in symmetric_graph.
+  template <class Edge>
+  DirGraph delete_edges_batch_2(size_t m, Edge* edges,
+                                bool sorted = false, bool remove_dups = false,
+                                size_t nn = std::numeric_limits<size_t>::max(),
+                                bool run_seq = false) {
+    return DirGraph(delete_edges(m, edges, remove_dups, false));
+  }
+
+  template <class Edge>
+  void delete_edges_batch_3(size_t m, Edge* edges,
+                            bool sorted = false, bool remove_dups = false,
+                            size_t nn = std::numeric_limits<size_t>::max(),
+                            bool run_seq = false) {
+    V = delete_edges(m, edges, remove_dups, true);
+  }
+};
+
+}  // namespace aspen
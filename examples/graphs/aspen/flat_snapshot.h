@@ -0,0 +1,109 @@
+#pragma once
+
+#include "utils.h"
+
+#include <array>
+#include <memory>
+
+namespace aspen {
+
+// A flat snapshot maps every vertex id of one version of a graph to the
+// vertex's data (Graph::vertex_data: the root of its edge tree, or of its in-
+// and out-edge trees in a directed graph), for O(1) random vertex access
+// during traversals. The entries are not reference counted, so the snapshot
+// is only valid while the version it was taken from is alive.
+//
+// The entries live in fixed-size pages that snapshots share copy-on-write:
+// update() derives the snapshot of the next version from this one and the
+// vertices whose edges a batch changed, copying only the pages holding those
+// vertices, plus the page table. Edge trees of the other vertices are shared
+// by the two versions, so their entries stay valid.
+template <class vertex_data>
+struct flat_snapshot {
+  static constexpr size_t kPageBits = 10;
+  static constexpr size_t kPageSize = size_t{1} << kPageBits;
+  using page = std::array<vertex_data, kPageSize>;
+
+  flat_snapshot() : n(0) {}
+
+  size_t size() const { return n; }
+
+  vertex_data operator[](size_t v) const {
+    return (*pages[v >> kPageBits])[v & (kPageSize - 1)];
+  }
+
+  // Takes a snapshot of G from scratch, in O(n) work.
+  template <class Graph>
+  static flat_snapshot from_graph(Graph& G) {
+    flat_snapshot fs;
+    fs.n = G.num_vertices();
+    fs.pages = parlay::tabulate(num_pages(fs.n), [] (size_t) {
+      return empty_page(); });
+    auto map_f = [&](const auto& vtx) {
+      const vertex_id& v = vtx.id;
+      (*fs.pages[v >> kPageBits])[v & (kPageSize - 1)] = vtx.data();
+    };
+    G.map_vertices(map_f);
+    return fs;
+  }
+
+  // The snapshot of G, the version that follows this snapshot's version
+  // after a batch that changed the edges of the (sorted, distinct) vertices
+  // in changed. Takes O(n / kPageSize + |changed| * kPageSize) work and
+  // leaves this snapshot unchanged.
+  template <class Graph, class Seq>
+  flat_snapshot update(Graph& G, const Seq& changed) const {
+    flat_snapshot fs;
+    fs.n = G.num_vertices();
+    size_t old_pages = pages.size();
+    fs.pages = parlay::tabulate(num_pages(fs.n), [&] (size_t i) {
+      return (i < old_pages) ? pages[i] : empty_page(); });
+
+    // one task per page holding changed vertices
+    size_t k = changed.size();
+    auto page_of = [&] (size_t i) { return changed[i] >> kPageBits; };
+    auto starts = parlay::pack_index<size_t>(
+        parlay::delayed_seq<bool>(k, [&] (size_t i) {
+          return (changed[i] < fs.n) &&
+                 (i == 0 || page_of(i) != page_of(i - 1)); }));
+    parlay::parallel_for(0, starts.size(), [&] (size_t j) {
+      size_t p = page_of(starts[j]);
+      auto copy = std::make_shared<page>(*fs.pages[p]);
+      for (size_t i = starts[j]; i < k && page_of(i) == p; i++) {
+        vertex_id v = changed[i];
+        if (v < fs.n) (*copy)[v & (kPageSize - 1)] = G.get_vertex(v).data();
+      }
+      fs.pages[p] = std::move(copy);
+    }, 1);
+    return fs;
+  }
+
+  // The sorted, distinct vertices whose edge trees a batch update with the
+  // m edges changes: their sources, and in a directed graph (which also
+  // updates the in-edge trees of the targets) their targets.
+  template <class Edge>
+  static parlay::sequence<vertex_id> changed_vertices(size_t m, Edge* edges,
+                                                      bool directed = false) {
+    size_t k = directed ? 2 * m : m;
+    auto ids = parlay::sort(parlay::tabulate(k, [&] (size_t i) {
+      return static_cast<vertex_id>((i < m) ? std::get<0>(edges[i])
+                                            : std::get<1>(edges[i - m])); }));
+    auto flags = parlay::delayed_seq<bool>(k, [&] (size_t i) {
+      return i == 0 || ids[i] != ids[i - 1]; });
+    return parlay::pack(ids, flags);
+  }
+
+ private:
+  size_t n;
+  parlay::sequence<std::shared_ptr<page>> pages;
+
+  static size_t num_pages(size_t n) { return (n + kPageSize - 1) >> kPageBits; }
+
+  static std::shared_ptr<page> empty_page() {
+    auto p = std::make_shared<page>();
+    p->fill(vertex_data());
+    return p;
+  }
+};
+
+}  // namespace aspen
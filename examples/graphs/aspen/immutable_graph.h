@@ -151,9 +151,14 @@ struct symmetric_graph {
     }
   };
 
+  // The value of a vertex in the vertex tree.
+  using vertex_data = edge_node*;
+  static constexpr bool is_directed = false;
+
   struct vertex {
     vertex_id id;
     edge_node* edges;
+    vertex_data data() const { return edges; }
     size_t out_degree() {
       return edge_tree::size(edges);
     }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "flags.h"
+#include "flat_snapshot.h"
 #include "vertex_subset.h"
 
 namespace aspen {
@@ -66,7 +67,10 @@ struct traversable_graph : private graph {
   using vertex = typename G::vertex;
   using weight_type = typename graph::weight_type;
   using ngh_and_weight = typename graph::ngh_and_weight;
+  using vertex_data = typename G::vertex_data;
   using Empty = empty;
+  using flat_snap_t = flat_snapshot<vertex_data>;
+  static constexpr bool is_directed = G::is_directed;
 
   // for coercing the underlying graph to an traversable_graph
   traversable_graph(graph&& m) {
@@ -77,6 +81,8 @@ struct traversable_graph : private graph {
   }
   traversable_graph() {}
 
+  // Pushes from the vertices of vs along their out-edges (their in-edges
+  // with the in_edges flag).
   template <class Data, class VS, class F>
   auto edgeMapSparse(VS& vs, parlay::sequence<vertex>& vertices, F& f,
                      const flags& fl) {
@@ -97,7 +103,7 @@ struct traversable_graph : private graph {
         edge_id o = offsets[i];
         auto& vtx = vertices[i];
         auto neighbors =
-            (fl & in_edges) ? vtx.out_neighbors() : vtx.in_neighbors();
+            (fl & in_edges) ? vtx.in_neighbors() : vtx.out_neighbors();
         S* out_edges = outEdges.begin();
         auto g = get_emsparse_gen_full<Data>(out_edges);
 
@@ -114,7 +120,7 @@ struct traversable_graph : private graph {
       parlay::parallel_for(0, vertices.size(), [&](size_t i) {
         auto& vtx = vertices[i];
         auto neighbors =
-            (fl & in_edges) ? vtx.out_neighbors() : vtx.in_neighbors();
+            (fl & in_edges) ? vtx.in_neighbors() : vtx.out_neighbors();
 
         auto map_f = [&](vertex_id v, vertex_id u, auto wgh, size_t i) {
           f.updateAtomic(v, u, wgh);
@@ -126,7 +132,7 @@ struct traversable_graph : private graph {
   }
 
   template <class Data, class VS, class F>
-  auto edgeMapSparse(VS& vs, parlay::sequence<edge_node*>& flat_snap, F& f,
+  auto edgeMapSparse(VS& vs, const flat_snap_t& flat_snap, F& f,
                      const flags& fl) {
     using S = typename vertexSubsetData<Data>::S;
     size_t n = num_vertices();
@@ -145,7 +151,7 @@ struct traversable_graph : private graph {
         auto vtx = vertex(v, flat_snap[v]);
         edge_id o = offsets[i];
         auto neighbors =
-            (fl & in_edges) ? vtx.out_neighbors() : vtx.in_neighbors();
+            (fl & in_edges) ? vtx.in_neighbors() : vtx.out_neighbors();
         S* out_edges = outEdges.begin();
         auto g = get_emsparse_gen_full<Data>(out_edges);
 
@@ -163,7 +169,7 @@ struct traversable_graph : private graph {
         uintE v = vs.vtx(i);
         auto vtx = vertex(v, flat_snap[v]);
         auto neighbors =
-            (fl & in_edges) ? vtx.out_neighbors() : vtx.in_neighbors();
+            (fl & in_edges) ? vtx.in_neighbors() : vtx.out_neighbors();
 
         auto map_f = [&](vertex_id v, vertex_id u, auto wgh, size_t i) {
           f.updateAtomic(v, u, wgh);
@@ -174,6 +180,8 @@ struct traversable_graph : private graph {
     }
   }
 
+  // Pulls into every vertex along its in-edges (its out-edges with the
+  // in_edges flag), i.e., along the same edges edgeMapSparse pushes over.
   template <class F>
   vertexSubset edgeMapDense(vertexSubset& vs, F& f, const flags& fl) {
     size_t n = num_vertices();
@@ -185,7 +193,8 @@ struct traversable_graph : private graph {
       auto map_f = [&](const auto& vtx) {
         vertex_id v = vtx.id;
         if (f.cond(v)) {
-          auto neighbors = vtx.in_neighbors();
+          auto neighbors =
+              (fl & in_edges) ? vtx.out_neighbors() : vtx.in_neighbors();
           auto map_cond = [&](const vertex_id& v, const vertex_id& ngh,
                               const auto& wgh) -> bool {
             if (prev[ngh] && f.update(ngh, v, wgh)) {
@@ -204,7 +213,8 @@ struct traversable_graph : private graph {
       auto map_f = [&](const auto& vtx) {
         vertex_id v = vtx.id;
         if (f.cond(v)) {
-          auto neighbors = vtx.in_neighbors();
+          auto neighbors =
+              (fl & in_edges) ? vtx.out_neighbors() : vtx.in_neighbors();
           auto map_cond = [&](const vertex_id& v, const vertex_id& ngh,
                               const auto& wgh) -> bool {
             if (prev[ngh]) {
@@ -222,7 +232,7 @@ struct traversable_graph : private graph {
 
   template <class F>
   vertexSubset edgeMapDense(vertexSubset& vs,
-                            parlay::sequence<edge_node*>& flat_snap, F& f,
+                            const flat_snap_t& flat_snap, F& f,
                             const flags& fl) {
     size_t n = num_vertices();
     vs.toDense();
@@ -235,7 +245,8 @@ struct traversable_graph : private graph {
       parlay::parallel_for(0, n, [&] (size_t v) {
         if (f.cond(v)) {
           auto vtx = vertex(v, flat_snap[v]);
-          auto neighbors = vtx.in_neighbors();
+          auto neighbors =
+              (fl & in_edges) ? vtx.out_neighbors() : vtx.in_neighbors();
           auto map_cond = [&](const vertex_id& v, const vertex_id& ngh,
                               const auto& wgh) -> bool {
             if (prev[ngh] && f.update(ngh, v, wgh)) {
@@ -252,7 +263,8 @@ struct traversable_graph : private graph {
       parlay::parallel_for(0, n, [&] (size_t v) {
         if (f.cond(v)) {
           auto vtx = vertex(v, flat_snap[v]);
-          auto neighbors = vtx.in_neighbors();
+          auto neighbors =
+              (fl & in_edges) ? vtx.out_neighbors() : vtx.in_neighbors();
           auto map_cond = [&](const vertex_id& v, const vertex_id& ngh,
                               const auto& wgh) -> bool {
             if (prev[ngh]) {
@@ -316,7 +328,7 @@ struct traversable_graph : private graph {
   }
 
   template <class Data, class VS, class F>
-  auto edgeMapData(VS& vs, F& f, parlay::sequence<edge_node*>& flat_snap,
+  auto edgeMapData(VS& vs, F& f, const flat_snap_t& flat_snap,
                    long threshold = -1, const flags& fl = 0) {
     size_t n = num_vertices();
     size_t m = num_edges();
@@ -351,7 +363,7 @@ struct traversable_graph : private graph {
   }
 
   template <class VS, class F>
-  auto edgeMap(VS& vs, F f, parlay::sequence<edge_node*>& flat_snap,
+  auto edgeMap(VS& vs, F f, const flat_snap_t& flat_snap,
                long threshold = -1, const flags& fl = 0) {
     if (flat_snap.size() == 0) {
       return edgeMapData<Empty, VS, F>(vs, f, threshold, fl);
@@ -360,15 +372,10 @@ struct traversable_graph : private graph {
     }
   }
 
-  parlay::sequence<edge_node*> fetch_all_vertices() {
-    size_t n = G::num_vertices();
-    auto vtxs = parlay::sequence<edge_node*>(n, nullptr);
-    auto map_f = [&](const auto& vtx) {
-      const uintE& v = vtx.id;
-      vtxs[v] = vtx.edges;
-    };
-    G::map_vertices(map_f);
-    return vtxs;
+  // A flat snapshot of this version, built from scratch. See
+  // flat_snapshot::update to derive it from the previous version's.
+  flat_snap_t fetch_all_vertices() {
+    return flat_snap_t::from_graph(*this);
   }
 
   template <class Edge>
@@ -6,6 +6,7 @@
 #include "sequentialHT.h"
 
 #include <limits>
+#include <memory>
 
 namespace aspen {
 
@@ -32,6 +33,8 @@ struct versioned_graph {
   using Tree = typename snapshot_graph::vertex_tree::Tree;
   using Node = typename snapshot_graph::vertex_node;
   using Node_GC = typename snapshot_graph::vertex_gc;
+  using flat_snap_t = typename snapshot_graph::flat_snap_t;
+  using flat_snap_ptr = std::shared_ptr<const flat_snap_t>;
 
   // Currently wasteful; ts is duplicated.
   using K = uint64_t;
@@ -40,14 +43,23 @@ struct versioned_graph {
   using table = sequentialHT<K, V>;
   table live_versions;
 
+  // With enable_flat_snapshots(), the flat snapshot of each live version,
+  // indexed by its slot in live_versions. Each version's snapshot is derived
+  // from the previous version's by the batch that created it.
+  bool flat_snapshots = false;
+  parlay::sequence<flat_snap_ptr> flat_snaps;
+
   static constexpr typename table::T empty = std::make_tuple(max_ts, std::make_tuple(0, nullptr));
 
   struct version {
     ts timestamp;
     T* table_entry;
     snapshot_graph graph;
-    version(ts _timestamp, T* _table_entry, snapshot_graph&& _graph) :
-      timestamp(_timestamp), table_entry(_table_entry) {
+    flat_snap_ptr flat_snap;  // null unless flat snapshots are enabled
+    version(ts _timestamp, T* _table_entry, snapshot_graph&& _graph,
+            flat_snap_ptr _flat_snap = nullptr) :
+      timestamp(_timestamp), table_entry(_table_entry),
+      flat_snap(std::move(_flat_snap)) {
       graph.set_root(_graph.get_root());
       _graph.clear_root();
     }
@@ -101,6 +113,19 @@ struct versioned_graph {
     return current_timestamp-1;
   }
 
+  // Maintains a flat snapshot with every version committed from now on,
+  // starting with a full one of the latest version. Single writer, like the
+  // batch updates; call it before readers use flat snapshots.
+  void enable_flat_snapshots() {
+    if (flat_snapshots) return;
+    flat_snaps = parlay::sequence<flat_snap_ptr>(live_versions.m);
+    auto S = acquire_version();
+    flat_snaps[slot_of(S.table_entry)] =
+        std::make_shared<const flat_snap_t>(S.graph.fetch_all_vertices());
+    flat_snapshots = true;
+    release_version(std::move(S));
+  }
+
   // Lock-free, but not wait-free
   version acquire_version() {
     while (true) {
@@ -120,7 +145,8 @@ struct versioned_graph {
             if (cpam::utils::atomic_compare_and_swap(&std::get<0>(std::get<1>(table_ref)), refct_and_ts, next_value)) {
               auto graph = snapshot_graph(std::get<1>(std::get<1>(table_ref)));
 //              std::cout << "Success in CAS! graph = " << graph.get_root() << " ref_cnt = " << graph.ref_cnt() << std::endl;
-              return version(ts, &table_ref, std::move(graph));
+              flat_snap_ptr fs = flat_snapshots ? flat_snaps[slot_of(&table_ref)] : nullptr;
+              return version(ts, &table_ref, std::move(graph), std::move(fs));
             }
           } else { // refct == 0
             break;
@@ -150,9 +176,10 @@ struct versioned_graph {
 //              std::cout << "Bad ref_cnt when deleting version. Ref cnt = " << Tree::ref_cnt(root) << std::endl;
 //              exit(0);
 //            }
-            Node_GC::decrement_recursive(root);
+            Node_GC::retire(root);
           }
 
+          if (flat_snapshots) flat_snaps[slot_of(table_entry)] = nullptr;
           typename table::T first_empty = std::make_tuple(timestamp, std::make_tuple(0, nullptr));
           *table_entry = first_empty;
           typename table::T tomb_empty = std::make_tuple(tombstone, std::make_tuple(0, nullptr));
@@ -162,6 +189,12 @@ struct versioned_graph {
     }
   }
 
+  // In deferred mode (Node_GC::set_deferred(true)), released versions are
+  // only queued; this frees them, in parallel, and returns their number.
+  size_t collect_garbage() {
+    return Node_GC::collect();
+  }
+
   // single-entry
   template <class Edge>
   void insert_edges_batch(Edge& edges, bool sorted = false,
@@ -174,10 +207,12 @@ struct versioned_graph {
     // 1. Insert the new graph (not yet visible) into the live versions set
     snapshot_graph G_next = S.graph.insert_edges_batch(edges.size(), edges.begin(), sorted, remove_dups, nn, run_seq);
     assert(G_next.get_root());
+    auto fs = next_flat_snap(S, G_next, edges);
     live_versions.insert(std::make_tuple(current_timestamp,
                                     std::make_tuple(refct_utils::make_refct(current_timestamp, 1),
                                                G_next.get_root())));
     G_next.clear_root();
+    set_flat_snap(current_timestamp, std::move(fs));
     // 2. Make the new version visible
     cpam::utils::fetch_and_add(&current_timestamp, 1);
     release_version(std::move(S));
@@ -190,14 +225,16 @@ struct versioned_graph {
                           size_t nn = std::numeric_limits<size_t>::max(),
                           bool run_seq = false) {
     auto S = acquire_version();
-    const auto& G = S.graph;
+    auto& G = S.graph;
 
     // 1. Insert the new graph (not yet visible) into the live versions set
     snapshot_graph G_next = G.delete_edges_batch(edges.size(), edges.begin(), sorted, remove_dups, nn, run_seq);
+    auto fs = next_flat_snap(S, G_next, edges);
     live_versions.insert(std::make_tuple(current_timestamp,
                                     std::make_tuple(refct_utils::make_refct(current_timestamp, 1),
                                                G_next.get_root())));
     G_next.clear_root();
+    set_flat_snap(current_timestamp, std::move(fs));
 
     // 2. Make the new version visible
     cpam::utils::fetch_and_add(&current_timestamp, 1);
@@ -206,10 +243,14 @@ struct versioned_graph {
   }
 
   void add_version_from_graph(snapshot_graph G_next){
+    // no batch to derive it from
+    flat_snap_ptr fs = flat_snapshots ?
+        std::make_shared<const flat_snap_t>(G_next.fetch_all_vertices()) : nullptr;
     live_versions.insert(std::make_tuple(current_timestamp,
                                     std::make_tuple(refct_utils::make_refct(current_timestamp, 1),
                                                G_next.get_root())));
     G_next.clear_root();
+    set_flat_snap(current_timestamp, std::move(fs));
     
     std::cout << "New version released with timestamp " << current_timestamp << std::endl;
     // 2. Make the new version visible
@@ -217,6 +258,27 @@ struct versioned_graph {
   }
 
 
+ private:
+  size_t slot_of(const T* table_entry) {
+    return table_entry - live_versions.table.begin();
+  }
+
+  // The flat snapshot of G_next, made from S's by the batch of edges (which
+  // the batch update has sorted in place).
+  template <class Edge>
+  flat_snap_ptr next_flat_snap(const version& S, snapshot_graph& G_next, Edge& edges) {
+    if (!flat_snapshots) return nullptr;
+    auto changed = flat_snap_t::changed_vertices(edges.size(), edges.begin(),
+                                                 snapshot_graph::is_directed);
+    return std::make_shared<const flat_snap_t>(S.flat_snap->update(G_next, changed));
+  }
+
+  // Stores the snapshot of the not yet visible version t.
+  void set_flat_snap(ts t, flat_snap_ptr fs) {
+    if (!flat_snapshots) return;
+    T& table_ref = std::get<0>(live_versions.find(t));
+    flat_snaps[slot_of(&table_ref)] = std::move(fs);
+  }
 };
 
 }  // namespace aspen
@@ -119,8 +119,16 @@ double SimultaneousUpdatesQueries_runner(Graph& G, cpam::commandLine P) {
   bool query_only = P.getOption("-query_only");
   bool update_only = P.getOption("-update_only");
   auto algo_name = P.getOptionValue("-alg", "BFS");
+  // Queue released versions and free them every collect_every update batches.
+  bool defer_gc = P.getOption("-defer_gc");
+  size_t collect_every = P.getOptionLongValue("-collect_every", 1000);
   auto root = G.get_root();
   auto VG = versioned_graph<Graph>(std::move(G));
+  if (defer_gc) versioned_graph<Graph>::Node_GC::set_deferred(true);
+  // Derive each version's flat snapshot from the previous one's as batches
+  // are applied, instead of having each query build one from scratch.
+  bool inc_flatsnap = P.getOption("-inc_flatsnap");
+  if (inc_flatsnap) VG.enable_flat_snapshots();
   std::cout << "Initially, timestamp is: " << VG.latest_timestamp() << std::endl;
 
   std::cout << "After creating vg root ref_cnt = " << versioned_graph<Graph>::Tree::ref_cnt(root) << std::endl;
@@ -157,6 +165,7 @@ double SimultaneousUpdatesQueries_runner(Graph& G, cpam::commandLine P) {
       }
       auto slice = updates.cut(gran*i, gran*i+gran);
       VG.insert_edges_batch(slice);
+      if (defer_gc && (i+1) % collect_every == 0) VG.collect_garbage();
       double elapsed = t.get_total();
       times[i] = std::make_pair(elapsed, elapsed - last);
       last = elapsed;
@@ -183,12 +192,13 @@ double SimultaneousUpdatesQueries_runner(Graph& G, cpam::commandLine P) {
 
       timer bt; bt.start();
       std::cout << "Starting BFS on graph, ref_cnt = " << S.graph.ref_cnt() << " num_edges = " << S.graph.num_edges() << std::endl;
+      auto fs = S.flat_snap.get();  // null unless -inc_flatsnap
       if (algo_name == "BFS") {
-        BFS(S.graph, 10012, /*flatsnap=*/true);
+        BFS(S.graph, 10012, /*flatsnap=*/true, fs);
       } else if (algo_name == "BC") {
-        BC(S.graph, 10012, /*flatsnap=*/true);
+        BC(S.graph, 10012, /*flatsnap=*/true, fs);
       } else {
-        MaximalIndependentSet_rootset::MaximalIndependentSet(S.graph, /*flatsnap=*/true);
+        MaximalIndependentSet_rootset::MaximalIndependentSet(S.graph, /*flatsnap=*/true, fs);
       }
       double tt = bt.stop();
       double elapsed = t.get_total();
@@ -217,6 +227,7 @@ double SimultaneousUpdatesQueries_runner(Graph& G, cpam::commandLine P) {
     std::cout << "Running concurrent updates + queries" << std::endl;
     parlay::par_do(updater, queries);
   }
+  if (defer_gc) VG.collect_garbage();
   std::cout << "Finished " << queries_run << " many queries." << std::endl;
 
   std::cout << "At end of updates" << std::endl;
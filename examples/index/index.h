@@ -40,6 +40,8 @@ struct inv_index {
   //using post_list = aug_map<doc_entry>;
 #ifdef USE_DIFF_ENCODING
   using post_list = cpam::aug_map<doc_entry, 16, cpam::diffencoded_index_encoder>;
+#elif defined(USE_VALUE_CODEC)
+  using post_list = cpam::aug_map<doc_entry, 16, cpam::composite_entry_encoder<cpam::diffencoded_entry_encoder, cpam::varint_value_codec>>;
 #else
 #ifdef USE_PAM
   using post_list = aug_map<doc_entry>;
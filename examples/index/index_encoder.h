@@ -124,6 +124,33 @@ struct diffencoded_index_encoder {
       return ret;
     }
 
+    // Number of entries whose key is less than k.
+    template <class F, class Comp, class K>
+    static inline size_t rank(uint8_t* bytes, size_t size,
+          const F& f, const Comp& comp, const K& k) {
+      size_t ret = 0;
+      auto count = [&] (const ET& et) -> bool {
+        if (!comp(f(et), k)) return false;
+        ret++;
+        return true;
+      };
+      decode_cond(bytes, size, count);
+      return ret;
+    }
+
+    // The i-th entry of the block (i < size).
+    static inline ET select(uint8_t* bytes, size_t size, size_t i) {
+      std::optional<ET> ret;
+      size_t j = 0;
+      auto get = [&] (const ET& et) -> bool {
+        if (j++ < i) return true;
+        ret = et;
+        return false;
+      };
+      decode_cond(bytes, size, get);
+      return *ret;
+    }
+
     static inline void destroy(uint8_t* bytes, size_t size) { }
   };
 };
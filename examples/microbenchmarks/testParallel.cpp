@@ -56,17 +56,41 @@ struct entry3 {
 };
 
 using par = std::tuple<key_type, key_type>;
-#ifdef USE_DIFF_ENCODING
+
+// weight_balanced_tree, avl_tree, red_black_tree or treap
+#ifndef BALANCE
+#define BALANCE weight_balanced_tree
+#endif
+
+#if defined(USE_STREAMVBYTE_ENCODING)
+#ifdef NO_AUG
+using tmap = streamvbyte_map<entry, BLOCK_SIZE, BALANCE>;
+#else
+using tmap = streamvbyte_aug_map<entry, BLOCK_SIZE, BALANCE>;
+#endif
+#elif defined(USE_BITPACKED_ENCODING)
+#ifdef NO_AUG
+using tmap = bitpacked_map<entry, BLOCK_SIZE, BALANCE>;
+#else
+using tmap = bitpacked_aug_map<entry, BLOCK_SIZE, BALANCE>;
+#endif
+#elif defined(USE_HYBRID_ENCODING)
+#ifdef NO_AUG
+using tmap = pam_map<entry, BLOCK_SIZE, hybrid_entry_encoder, BALANCE>;
+#else
+using tmap = aug_map<entry, BLOCK_SIZE, hybrid_entry_encoder, BALANCE>;
+#endif
+#elif defined(USE_DIFF_ENCODING)
 #ifdef NO_AUG
-using tmap = diff_encoded_map<entry, BLOCK_SIZE>;
+using tmap = diff_encoded_map<entry, BLOCK_SIZE, BALANCE>;
 #else
-using tmap = diff_encoded_aug_map<entry, BLOCK_SIZE>;
+using tmap = diff_encoded_aug_map<entry, BLOCK_SIZE, BALANCE>;
 #endif
 #else
 #ifdef NO_AUG
-using tmap = pam_map<entry, BLOCK_SIZE>;
+using tmap = pam_map<entry, BLOCK_SIZE, default_entry_encoder, BALANCE>;
 #else
-using tmap = aug_map<entry, BLOCK_SIZE>;
+using tmap = aug_map<entry, BLOCK_SIZE, default_entry_encoder, BALANCE>;
 #endif
 #endif
 
@@ -157,10 +157,8 @@ struct RangeQuery {
       }
     }
     void add_aug_val(inner_map a) {
-      inner_map r = inner_map::range(a, y1, y2);
-      size_t s = r.size();
-      inner_map::keys(r,out);
-      out += s;
+      inner_map::range_foreach(a, y1, y2, [&] (const auto& e) {
+        *out++ = inner_map::Entry::get_key(e); });
     }
   };
 
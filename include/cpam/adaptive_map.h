@@ -0,0 +1,269 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <optional>
+#include <tuple>
+#include <variant>
+
+namespace cpam {
+
+// *******************************************
+//   ADAPTIVE BLOCK SIZE MAPS
+// *******************************************
+
+// A map whose leaf block size is chosen when it is constructed, from the
+// sizes in Bs, instead of being fixed by its type. Family::template map<B>
+// is the map type for block size B (see pam_map_family below); the block
+// size, and with it the node layout, kBaseCaseSize and kNodeLimit, is that
+// of the alternative currently held, so one binary can keep scan-heavy maps
+// with large blocks and update-heavy maps with small ones.
+//
+// The map also counts its workload (point reads, entries scanned, entries
+// updated) and retune() rebuilds it with the block size that the counts
+// favor. Larger blocks make scans cheaper (fewer nodes per entry) and
+// updates and point reads more expensive (a whole block is decoded and
+// re-encoded); the cost model below balances the two. A rebuild takes O(n)
+// work, so retune() only rebuilds once the workload since the last rebuild
+// is at least the size of the map.
+//
+// Operations not provided here can be applied to the underlying map with
+// visit(). Like the maps it wraps, the map can be read from many threads at
+// once, but updates must not run concurrently with other operations.
+template <class Family, size_t... Bs>
+struct adaptive_map_ {
+  static_assert(sizeof...(Bs) > 0, "adaptive_map_ needs a block size");
+  using M0 = typename Family::template map<std::get<0>(std::make_tuple(Bs...))>;
+  using Entry = typename M0::Entry;
+  using E = typename M0::E;
+  using K = typename M0::K;
+  using V = typename M0::V;
+  using maybe_V = std::optional<V>;
+  using variant = std::variant<typename Family::template map<Bs>...>;
+
+  static constexpr std::array<size_t, sizeof...(Bs)> block_sizes = {Bs...};
+
+  // Cost of visiting a node relative to decoding one entry of a block.
+  static constexpr double kNodeCost = 64;
+
+  struct workload {
+    size_t point_reads = 0;  // find, contains
+    size_t scanned = 0;      // entries visited by scans
+    size_t updates = 0;      // entries inserted or removed
+  };
+
+  // An empty map with the given block size, rounded up to the nearest
+  // available size (or the largest one).
+  explicit adaptive_map_(size_t block_size = 128)
+    : m(make(index_of(block_size))) {}
+
+  // A map of the sorted, distinct entries S.
+  template <class Seq>
+  adaptive_map_(Seq& S, size_t block_size) : m(make(index_of(block_size))) {
+    std::visit([&] (auto& x) {
+      x = std::decay_t<decltype(x)>::from_sorted(S); }, m);
+  }
+
+  adaptive_map_(const adaptive_map_& a) : m(a.m) {}
+  adaptive_map_(adaptive_map_&& a) : m(std::move(a.m)) {}
+  adaptive_map_& operator = (const adaptive_map_& a) {
+    m = a.m; reset_workload(); return *this; }
+  adaptive_map_& operator = (adaptive_map_&& a) {
+    m = std::move(a.m); reset_workload(); return *this; }
+
+  size_t block_size() const { return block_sizes[m.index()]; }
+  size_t base_case_size() const {
+    return std::visit([] (const auto& x) {
+      return std::decay_t<decltype(x)>::Tree::kBaseCaseSize; }, m);
+  }
+  size_t node_limit() const {
+    return std::visit([] (const auto& x) {
+      return std::decay_t<decltype(x)>::kNodeLimit; }, m);
+  }
+
+  size_t size() const {
+    return std::visit([] (const auto& x) { return x.size(); }, m); }
+
+  maybe_V find(const K& k) const {
+    count(point_reads);
+    return std::visit([&] (const auto& x) -> maybe_V { return x.find(k); }, m);
+  }
+
+  bool contains(const K& k) const {
+    count(point_reads);
+    return std::visit([&] (const auto& x) { return x.contains(k); }, m);
+  }
+
+  void insert(const E& e) {
+    count(updates);
+    std::visit([&] (auto& x) { x.insert(e); }, m);
+  }
+
+  void remove(const K& k) {
+    count(updates);
+    std::visit([&] (auto& x) { x.remove(k); }, m);
+  }
+
+  // Inserts the entries of S (in any order, one per key), replacing those
+  // already in the map with the same keys.
+  template <class Seq>
+  void multi_insert(Seq const& S) {
+    count(updates, S.size());
+    std::visit([&] (auto& x) {
+      using Mx = std::decay_t<decltype(x)>;
+      x = Mx::multi_insert(std::move(x), S); }, m);
+  }
+
+  // Removes the keys in the sorted sequence S (non-const, since the
+  // underlying maps take its elements by pointer).
+  template <class Seq>
+  void multi_delete_sorted(Seq& S) {
+    count(updates, S.size());
+    std::visit([&] (auto& x) {
+      using Mx = std::decay_t<decltype(x)>;
+      x = Mx::multi_delete_sorted(std::move(x), parlay::make_slice(S)); }, m);
+  }
+
+  parlay::sequence<E> entries() const {
+    count(scanned, size());
+    return std::visit([] (const auto& x) {
+      return std::decay_t<decltype(x)>::entries(x); }, m);
+  }
+
+  // f(e, i) on every entry, in parallel.
+  template <class F>
+  void foreach_index(const F& f) const {
+    count(scanned, size());
+    std::visit([&] (const auto& x) {
+      std::decay_t<decltype(x)>::foreach_index(x, f); }, m);
+  }
+
+  // f(e), in key order, on the entries with keys in [kl, kr].
+  template <class F>
+  void range_foreach(const K& kl, const K& kr, const F& f) const {
+    size_t n = 0;
+    auto g = [&] (const E& e) { n++; f(e); };
+    std::visit([&] (const auto& x) {
+      std::decay_t<decltype(x)>::range_foreach(x, kl, kr, g); }, m);
+    count(scanned, n);
+  }
+
+  template <class R, class F>
+  typename R::T map_reduce(const F& f, const R& r) const {
+    count(scanned, size());
+    return std::visit([&] (const auto& x) {
+      using Mx = std::decay_t<decltype(x)>;
+      return Mx::template map_reduce<R>(x, f, r); }, m);
+  }
+
+  // f(x) on the underlying map, whose type depends on the block size.
+  // f's result must not depend on that type.
+  template <class F>
+  auto visit(const F& f) { return std::visit(f, m); }
+  template <class F>
+  auto visit(const F& f) const { return std::visit(f, m); }
+
+  // Rebuilds the map with the given block size (rounded as in the
+  // constructor), if it differs from the current one.
+  void set_block_size(size_t block_size) {
+    size_t i = index_of(block_size);
+    if (i == m.index()) return;
+    auto S = std::visit([] (auto& x) {
+      using Mx = std::decay_t<decltype(x)>;
+      return Mx::entries(std::move(x)); }, m);
+    m = make(i);
+    std::visit([&] (auto& x) {
+      x = std::decay_t<decltype(x)>::from_sorted(S); }, m);
+  }
+
+  workload get_workload() const {
+    return {point_reads.load(std::memory_order_relaxed),
+            scanned.load(std::memory_order_relaxed),
+            updates.load(std::memory_order_relaxed)};
+  }
+
+  void reset_workload() {
+    point_reads.store(0); scanned.store(0); updates.store(0);
+  }
+
+  // The block size that the workload w favors, for a map of n entries.
+  // Reading or updating an entry decodes (and on update re-encodes) about
+  // half a block and visits log(n/B) nodes; scanning an entry costs one
+  // decode and 1/B of a node visit.
+  static size_t preferred_block_size(const workload& w, size_t n) {
+    size_t best = block_sizes[0];
+    double best_cost = -1;
+    for (size_t b : block_sizes) {
+      double depth = std::log2((double)n / b + 1);
+      double cost = w.point_reads * (b / 2.0 + kNodeCost * depth) +
+                    w.updates * (b + kNodeCost * depth) +
+                    w.scanned * (1 + kNodeCost / b);
+      if (best_cost < 0 || cost < best_cost) {
+        best = b; best_cost = cost;
+      }
+    }
+    return best;
+  }
+
+  // Rebuilds the map with the preferred block size once enough work has
+  // been observed since the last rebuild. Returns whether it rebuilt.
+  bool retune() {
+    workload w = get_workload();
+    size_t n = size();
+    if (w.point_reads + w.scanned + w.updates < std::max<size_t>(n, 1)) {
+      return false;
+    }
+    size_t b = preferred_block_size(w, n);
+    reset_workload();
+    if (b == block_size()) return false;
+    set_block_size(b);
+    return true;
+  }
+
+ private:
+  variant m;
+  mutable std::atomic<size_t> point_reads{0};
+  mutable std::atomic<size_t> scanned{0};
+  mutable std::atomic<size_t> updates{0};
+
+  static void count(std::atomic<size_t>& c, size_t n = 1) {
+    c.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  static size_t index_of(size_t block_size) {
+    for (size_t i = 0; i < block_sizes.size(); i++) {
+      if (block_sizes[i] >= block_size) return i;
+    }
+    return block_sizes.size() - 1;
+  }
+
+  template <size_t I = 0>
+  static variant make(size_t i) {
+    if constexpr (I + 1 < sizeof...(Bs)) {
+      if (i != I) return make<I + 1>(i);
+    }
+    return variant(std::in_place_index<I>);
+  }
+};
+
+template <class _Entry, class Encoder=default_entry_encoder, class Balance=weight_balanced_tree>
+struct pam_map_family {
+  template <size_t B>
+  using map = pam_map<_Entry, B, Encoder, Balance>;
+};
+
+template <class _Entry, class Encoder=default_entry_encoder, class Balance=weight_balanced_tree>
+struct pam_set_family {
+  template <size_t B>
+  using map = pam_set<_Entry, B, Encoder, Balance>;
+};
+
+template <class _Entry, class Encoder=default_entry_encoder, class Balance=weight_balanced_tree>
+using adaptive_pam_map =
+    adaptive_map_<pam_map_family<_Entry, Encoder, Balance>, 16, 32, 64, 128, 256>;
+
+template <class _Entry, class Encoder=default_entry_encoder, class Balance=weight_balanced_tree>
+using adaptive_pam_set =
+    adaptive_map_<pam_set_family<_Entry, Encoder, Balance>, 16, 32, 64, 128, 256>;
+
+}  // namespace cpam
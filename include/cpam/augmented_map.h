@@ -82,6 +82,12 @@ public:
   static M filter(M m, const F& f) {return to_aug(Map::filter(std::move(m), f));}
   static M multi_insert(M m, parlay::sequence<E> const &SS) {
     return to_aug(Map::multi_insert(std::move(m), SS));}
+  template<class Seq>
+  static M from_sorted(Seq &S) {return to_aug(Map::from_sorted(S));}
+  static M open(const std::string& path) {
+    static_assert(snapshot_storable<A>,
+                  "snapshots store augmented values verbatim");
+    return to_aug(Map::open(path));}
   template<class Seq, class BinOp>
   static M multi_insert_sorted(M m, Seq const &SS, BinOp f) {
     return to_aug(Map::multi_insert_sorted(std::move(m), SS, f));
@@ -149,6 +155,22 @@ public:
   static typename R::T map_reduce(const M& m, const F& f, const R& r,
 				  size_t grain=kNodeLimit) {
     return Map::template map_reduce<R>(m, f, r, grain);}
+  template<class R, class F>
+  static typename R::T map_reduce_columns(const M& m, const F& f, const R& r,
+				  size_t grain=kNodeLimit) {
+    return Map::template map_reduce_columns<R>(m, f, r, grain);}
+  template<class F>
+  static void range_foreach(const M& m, const K& kl, const K& kr, const F& f) {
+    Map::range_foreach(m, kl, kr, f);}
+  template <class FI, class FD, class FU>
+  static void diff(const M& old_m, const M& new_m, const FI& on_insert,
+                   const FD& on_delete, const FU& on_update) {
+    Map::diff(old_m, new_m, on_insert, on_delete, on_update);}
+  template<class R, class F>
+  static typename R::T range_map_reduce(const M& m, const K& kl, const K& kr,
+                                        const F& f, const R& r,
+                                        size_t grain=kNodeLimit) {
+    return Map::template range_map_reduce<R>(m, kl, kr, f, r, grain);}
   template<class F>
   static void map_index(M m, const F& f, size_t granularity = kNodeLimit,
 			size_t start=0) {
@@ -178,7 +200,9 @@ public:
     Map::foreach_seq(m, f);
   }
 public:
-  using Map::from_sorted;
+  using typename Map::cursor;
+  using Map::get_cursor;
+  using Map::save;
   using Map::size;
   using Map::is_empty;
   using Map::init;
@@ -199,6 +223,8 @@ public:
   using Map::check_structure;
   using Map::size_in_bytes;
   using Map::node_stats;
+  using Map::op_stats;
+  using Map::reset_op_stats;
   using Map::iterate_seq;
   using Map::ref_cnt;
 };
@@ -232,6 +258,12 @@ using aug_map =
 template <class _Entry, size_t BlockSize=256, class Balance=weight_balanced_tree>
 using diff_encoded_aug_map = aug_map<_Entry, BlockSize, diffencoded_entry_encoder, Balance>;
 
+template <class _Entry, size_t BlockSize=256, class Balance=weight_balanced_tree>
+using streamvbyte_aug_map = aug_map<_Entry, BlockSize, streamvbyte_entry_encoder, Balance>;
+
+template <class _Entry, size_t BlockSize=256, class Balance=weight_balanced_tree>
+using bitpacked_aug_map = aug_map<_Entry, BlockSize, bitpacked_entry_encoder, Balance>;
+
 // creates a key-value pair for the entry, and redefines from_entry
 template <class entry>
 struct aug_set_full_entry : entry {
@@ -242,6 +274,7 @@ struct aug_set_full_entry : entry {
   static inline key_t get_key(const entry_t& e) { return e; }
   static inline val_t get_val(const entry_t& e) { return 0; }
   static inline void set_val(entry_t& e, const val_t& v) {}
+  static inline entry_t to_entry(const key_t& k, const val_t& v) { return k; }
 };
 
 // _Entry needs:
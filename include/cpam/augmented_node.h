@@ -28,7 +28,7 @@ struct aug_node : public basic_node<balance,
   using regular_node = typename basic::regular_node;
   using compressed_node = typename basic::compressed_node;
   using allocator = typename basic::allocator;
-  using complex_allocator = typename basic::complex_allocator;
+  using stats = typename basic::stats;
 
   using basic::increment_count;
   using basic::empty;
@@ -49,6 +49,8 @@ struct aug_node : public basic_node<balance,
     node_size_t size_in_bytes;
     AT aug_val;
   };
+  using complex_allocator = compressed_allocator<aug,
+      2*B*sizeof(ET) + sizeof(aug_compressed_node)>;
 
   static bool is_regular(node* a) {
     return !a || ((regular_node*)a)->r & basic::kTopBit; }
@@ -89,6 +91,7 @@ struct aug_node : public basic_node<balance,
 
   // Handles both regular and compressed nodes.
   static void free_node(node* va) {
+    stats::add(stats::kFrees);
     if (basic::is_regular(va)) {
       auto a = basic::cast_to_regular(va);
       std::get<0>((a->entry)).~ET();
@@ -99,14 +102,18 @@ struct aug_node : public basic_node<balance,
       uint8_t* data_start = (((uint8_t*)c) + sizeof(aug_compressed_node));
       c->aug_val.~AT();
       AugEntryEncoder::destroy(data_start, c->s);
-      auto array_size = c->size_in_bytes;
-      utils::free_array<uint8_t>((uint8_t*)va, array_size);
+      complex_allocator::free(va, c->size_in_bytes);
     }
   }
 
   // precondition: a is non-null, and caller has a reference count on a.
+  // If that is the only reference, no other thread can reach a (increments
+  // are made through a reference), so a is freed without an atomic update;
+  // the acquire load orders the free after earlier releases by other threads.
   static bool decrement_count(node* a) {
-    if ((utils::fetch_and_add(&basic::generic_node(a)->r, -1) & basic::kLowBitMask) == 1) {
+    node_size_t* r = &basic::generic_node(a)->r;
+    if ((__atomic_load_n(r, __ATOMIC_ACQUIRE) & basic::kLowBitMask) == 1 ||
+        (utils::fetch_and_add(r, -1) & basic::kLowBitMask) == 1) {
       free_node(a);
       return true;
     }
@@ -168,6 +175,7 @@ struct aug_node : public basic_node<balance,
     } else {
       auto c = cast_to_compressed(a);
       uint8_t* data_start = (((uint8_t*)c) + sizeof(aug_compressed_node));
+      stats::add(stats::kDecodes);
       AugEntryEncoder::decode(data_start, c->s, f);
     }
   }
@@ -186,7 +194,10 @@ struct aug_node : public basic_node<balance,
     } else {
       auto c = cast_to_compressed(a);
       uint8_t* data_start = ((uint8_t*)c) + sizeof(aug_compressed_node);
-      return AugEntryEncoder::decode_cond(data_start, c->s, f);
+      // only a decode that reaches the end of the block counts
+      bool full = AugEntryEncoder::decode_cond(data_start, c->s, f);
+      if (full) stats::add(stats::kDecodes);
+      return full;
     }
   }
 
@@ -197,10 +208,58 @@ struct aug_node : public basic_node<balance,
     return AugEntryEncoder::find(data_start, c->s, f, comp, k);
   }
 
+  template <class F, class Comp, class K>
+  static size_t rank_compressed(node* b, const F& f, const Comp& comp, const K& k) {
+    auto c = cast_to_compressed(b);
+    uint8_t* data_start = ((uint8_t*)c) + sizeof(aug_compressed_node);
+    return AugEntryEncoder::rank(data_start, c->s, f, comp, k);
+  }
+
+  static ET select_compressed(node* b, size_t i) {
+    auto c = cast_to_compressed(b);
+    uint8_t* data_start = ((uint8_t*)c) + sizeof(aug_compressed_node);
+    return AugEntryEncoder::select(data_start, c->s, i);
+  }
+
+  // Calls f(E, n) with the n entries of the compressed node a stored in an
+  // array. E is only valid during the call.
+  template <class F>
+  static void decode_block(node* a, const F& f) {
+    auto c = cast_to_compressed(a);
+    uint8_t* data_start = ((uint8_t*)c) + sizeof(aug_compressed_node);
+    stats::add(stats::kDecodes);
+    basic_node_helpers::decode_block<AugEntryEncoder, ET, 2*B>(data_start, c->s, f);
+  }
+
+  // Writes the keys and values of the compressed node a to keys[0, size(a))
+  // and vals[0, size(a)). vals may be null if only the keys are needed.
+  template <class K, class V>
+  static void decode_columns(node* a, K* keys, V* vals) {
+    auto c = cast_to_compressed(a);
+    uint8_t* data_start = ((uint8_t*)c) + sizeof(aug_compressed_node);
+    stats::add(stats::kDecodes);
+    basic_node_helpers::decode_columns<AugEntryEncoder>(data_start, c->s, keys, vals);
+  }
+
+  static constexpr bool kBlockSetOps = has_block_set_ops<AugEntryEncoder>::value;
+
+  template <class K>
+  static long set_op_compressed(block_set_op op, node* a, node* b, K* out) {
+    if constexpr (kBlockSetOps) {
+      if (!is_compressed(a) || !is_compressed(b)) return -1;
+      auto ca = cast_to_compressed(a), cb = cast_to_compressed(b);
+      return AugEntryEncoder::set_op(op,
+          ((uint8_t*)ca) + sizeof(aug_compressed_node), ca->s,
+          ((uint8_t*)cb) + sizeof(aug_compressed_node), cb->s, out);
+    } else {
+      return -1;
+    }
+  }
+
   static node* finalize(node* root) {
     auto sz = basic::size(root);
-    assert(sz > 0);
-    if (sz < B) {
+    assert(sz > 0 || root == nullptr);
+    if (sz < B && sz > 0) {
       auto ret = make_compressed_node(root);
       decrement_recursive(root);
       return ret;
@@ -221,7 +280,10 @@ struct aug_node : public basic_node<balance,
 
     size_t encoded_size = AugEntryEncoder::encoded_size(e, s);
     size_t node_size = sizeof(aug_compressed_node) + encoded_size;
-    aug_compressed_node* c_node = (aug_compressed_node*)utils::new_array_no_init<uint8_t>(node_size);
+    aug_compressed_node* c_node = (aug_compressed_node*)complex_allocator::alloc(node_size);
+    stats::add(stats::kAllocs);
+    stats::add(stats::kEncodes);
+    stats::add(stats::kBytesEncoded, node_size);
 
     c_node->r = 1;
     c_node->s = s;
@@ -260,6 +322,7 @@ struct aug_node : public basic_node<balance,
     auto f = [&] (const ET& et) {
       parlay::assign_uninitialized(tmp_arr[i++], et);
     };
+    stats::add(stats::kDecodes);
     AugEntryEncoder::decode(data_start, c->s, f);
     return tmp_arr;
   }
@@ -0,0 +1,163 @@
+#pragma once
+#include "balance_utils.h"
+
+// *******************************************
+//   AVL TREES
+//   From the paper:
+//   Just Join for Parallel Ordered Sets
+//   G. Blelloch, D. Ferizovic, and Y. Sun
+//   SPAA 2016
+// *******************************************
+
+namespace cpam {
+
+struct avl_tree {
+
+  struct data { int height; };
+
+  // Blocks are leaves of height 1. Pieces too small to be a child (see
+  // balance_utils) are merged into the leaf at the end of the other tree's
+  // spine, which grows the height there by at most one, like an insertion.
+  //
+  // defines: node_join, regular_node_join, is_balanced, check_structure
+  // redefines: update, make_regular_node, single, make_compressed
+  template<class Node>
+  struct balance : public Node {
+    using node = typename Node::node;
+    using regular_node = typename Node::regular_node;
+    using t_utils = balance_utils<balance>;
+    using GC = gc<balance>;
+    using ET = typename Node::ET;
+    using Node::B;
+    friend t_utils;
+
+    static node* node_join(node* t1, node* t2, regular_node* k) {
+      if (t_utils::is_small_join(t1, t2)) return t_utils::small_join(t1, t2, k);
+      // A small side goes to a leaf of the other whatever its height.
+      if (t_utils::is_small(t2)) return right_join(t1, t2, k);
+      if (t_utils::is_small(t1)) return left_join(t1, t2, k);
+      if (is_left_heavy(t1, t2)) return right_join(t1, t2, k);
+      if (is_left_heavy(t2, t1)) return left_join(t1, t2, k);
+      k->lc = t1;
+      k->rc = t2;
+      update(k);
+      return k;
+    }
+
+    // For trees of regular nodes only.
+    static regular_node* regular_node_join(regular_node* t1, regular_node* t2, regular_node* k) {
+      return t_utils::regular_node_join(t1, t2, k);
+    }
+
+    static inline bool is_balanced(regular_node* t) {
+      return !t || !(is_left_heavy(t->lc, t->rc) || is_left_heavy(t->rc, t->lc));
+    }
+
+    static void update(node* t) {
+      Node::update(t);
+      auto r = Node::cast_to_regular(t);
+      r->height = std::max(height(r->lc), height(r->rc)) + 1;
+    }
+
+    template <class F>
+    static void lazy_update(node* t, const F& f) {
+      Node::lazy_update(t, f);
+      auto r = Node::cast_to_regular(t);
+      r->height = std::max(height(r->lc), height(r->rc)) + 1;
+    }
+
+    static regular_node* make_regular_node(const ET& e) {
+      regular_node* o = Node::make_regular_node(e);
+      o->height = 1;
+      return o;
+    }
+
+    static regular_node* single(const ET& e) {
+      regular_node* o = Node::single(e);
+      o->height = 1;
+      return o;
+    }
+
+    // The regular nodes made by Node::make_compressed have no height yet.
+    static node* make_compressed(node* l, node* r, regular_node* e) {
+      return set_heights(Node::make_compressed(l, r, e));
+    }
+
+    static node* make_compressed(ET* stack, size_t tot) {
+      return set_heights(Node::make_compressed(stack, tot));
+    }
+
+    static node* make_compressed(node* l, node* r) {
+      return make_compressed(l, r, nullptr);
+    }
+
+    static bool check_structure(node* b, size_t orig_tree_size = std::numeric_limits<size_t>::max()) {
+      return t_utils::check_structure(b, orig_tree_size);
+    }
+
+  private:
+    static int height(node* a) {
+      if (a == NULL) return 0;
+      if (Node::is_compressed(a)) return 1;
+      return Node::cast_to_regular(a)->height;
+    }
+
+    static node* set_heights(node* a) {
+      if (a && Node::is_regular(a)) {
+        auto r = Node::cast_to_regular(a);
+        set_heights(r->lc);
+        set_heights(r->rc);
+        r->height = std::max(height(r->lc), height(r->rc)) + 1;
+      }
+      return a;
+    }
+
+    static bool check_node(regular_node* t) {
+      return is_balanced(t) &&
+             t->height == std::max(height(t->lc), height(t->rc)) + 1;
+    }
+
+    // following two needed by balance_utils
+    static inline bool is_left_heavy(node* t1, node* t2) {
+      return height(t1) > height(t2) + 1;
+    }
+
+    static inline bool is_single_rotation(regular_node* t, bool dir) {
+      bool heavier = height(t->lc) > height(t->rc);
+      return dir ? heavier : !heavier;
+    }
+
+    // t1 is a regular node: t2 is shorter, or too small to be a child.
+    static node* right_join(node* t1, node* t2, regular_node* k) {
+      regular_node* t = Node::cast_to_regular(GC::copy_if_needed(t1));
+      t->rc = node_join(t->rc, t2, k);
+      if (is_left_heavy(t->rc, t->lc)) {
+        if (is_single_rotation(Node::cast_to_regular(t->rc), 0)) {
+          t = t_utils::rotate_left(t);
+        } else {
+          t = t_utils::double_rotate_left(t);
+        }
+      } else {
+        update(t);
+      }
+      return t;
+    }
+
+    static node* left_join(node* t1, node* t2, regular_node* k) {
+      regular_node* t = Node::cast_to_regular(GC::copy_if_needed(t2));
+      t->lc = node_join(t1, t->lc, k);
+      if (is_left_heavy(t->lc, t->rc)) {
+        if (is_single_rotation(Node::cast_to_regular(t->lc), 1)) {
+          t = t_utils::rotate_right(t);
+        } else {
+          t = t_utils::double_rotate_right(t);
+        }
+      } else {
+        update(t);
+      }
+      return t;
+    }
+  };
+};
+
+}  // namespace cpam
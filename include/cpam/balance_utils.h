@@ -329,6 +329,62 @@ struct balance_utils {
     return validate(ret);
   }
 
+/* ====================== Rank-based schemes with blocks ====================== */
+
+  // Used by the AVL, red-black and treap schemes. In a tree of more than 2B
+  // entries their regular nodes have two children that are each a regular
+  // node or a block of at least B entries (a leaf), so every regular node
+  // has more than 2B entries. Smaller pieces (empty trees, blocks of fewer
+  // than B entries and regular trees that fit in a block) are merged into a
+  // neighbouring leaf when they are joined.
+  static bool is_small(node* t) {
+    size_t s = Node::size(t);
+    return s < B || (Node::is_regular(t) && s <= 2*B);
+  }
+
+  // Whether joining t1 and t2 should just rebuild them into at most two
+  // blocks: either all of it fits in one block, or neither side is larger
+  // than a block and one of them can not be a child.
+  static bool is_small_join(node* t1, node* t2) {
+    size_t s1 = Node::size(t1), s2 = Node::size(t2);
+    return (s1 + s2 + 1 <= 2*B) ||
+           (s1 <= 2*B && s2 <= 2*B && (is_small(t1) || is_small(t2)));
+  }
+
+  // Returns a block, or a regular node over two blocks. Trees of fewer than
+  // B entries stay regular if they are, like the weight-balanced scheme
+  // (finalize compresses them).
+  static node* small_join(node* t1, node* t2, regular_node* k) {
+    size_t tot = Node::size(t1) + Node::size(t2) + 1;
+    if (tot < B && Node::is_regular(t1) && Node::is_regular(t2)) {
+      return Node::regular_node_join(Node::cast_to_regular(t1),
+                                     Node::cast_to_regular(t2), k);
+    }
+    return validate(Node::make_compressed(t1, t2, k));
+  }
+
+  // Checks the size invariants and, through Node::check_node, the scheme's
+  // invariant at every regular node.
+  static bool check_structure(node* b, size_t orig_tree_size) {
+    if (!b) return true;
+    if (orig_tree_size == std::numeric_limits<size_t>::max()) orig_tree_size = Node::size(b);
+    if (Node::is_compressed(b)) return Node::check_compressed_node(b);
+    size_t sz = Node::size(b);
+    if (!(sz >= 2*B || sz < B) || (orig_tree_size > 2*B && sz < B)) {
+      std::cout << "Check structure failed: regular node of size " << sz << std::endl;
+      assert(false);
+      exit(-1);
+    }
+    auto r = Node::cast_to_regular(b);
+    if (!Node::check_node(r)) {
+      std::cout << "Check balance failed" << std::endl;
+      assert(false);
+      exit(-1);
+    }
+    return check_structure(r->lc, orig_tree_size) &&
+           check_structure(r->rc, orig_tree_size);
+  }
+
 };
 
 }  // namespace cpam
@@ -4,7 +4,10 @@
 #include "utils.h"
 #include "basic_node_helpers.h"
 #include "byte_encode.h"
+#include "compressed_allocator.h"
+#include "stream_vbyte.h"
 #include "compression.h"
+#include "stats.h"
 
 namespace cpam {
 
@@ -21,6 +24,8 @@ public:
   using ET = _Entry;
   using node = void;
   using basic = basic_node<balance_data, _Entry, EntryEncoder, kBlockSize>;
+  // Counters shared by every map built on this node type.
+  using stats = op_stats<basic>;
 
   static constexpr size_t kCompressionBlockSize = kBlockSize;
   static constexpr size_t B = kCompressionBlockSize;
@@ -29,13 +34,18 @@ public:
   static constexpr size_t kNodeLimit = 4*B;
   static constexpr size_t kBlockSizeUpperBound = 2*B*sizeof(ET) + 3*sizeof(node_size_t);
 
-  struct regular_node : balance_data {
+  // The reference count and size come first in both kinds of node; the
+  // balancing scheme's data (empty for weight-balanced trees) follows the
+  // entry.
+  struct regular_node_fields {
     node_size_t r; // reference count, top-bit is always "1"
     node_size_t s;
     node* lc;
     node* rc;
     ET entry;
   };
+  struct regular_node : regular_node_fields, balance_data { };
+  using balance_t = balance_data;
   using allocator = parlay::type_allocator<regular_node>;
 
   struct compressed_node {
@@ -43,10 +53,9 @@ public:
     node_size_t s;              // number of entries used (size)
     node_size_t size_in_bytes;  // space allocated in bytes.
   };
-  // Complex nodes have between B and 2B elements.
-  struct complex_bytes {
-    uint8_t arr[kBlockSizeUpperBound];};
-  using complex_allocator = parlay::type_allocator<complex_bytes>;
+  // Complex nodes have between B and 2B elements. They are variable-sized
+  // and come from a size-class arena (one per node type).
+  using complex_allocator = compressed_allocator<basic, kBlockSizeUpperBound>;
 
   static bool is_complex(node* a) {
     assert(is_regular(a));
@@ -80,6 +89,7 @@ public:
 
   static regular_node* make_regular_node(const ET& e) {
     regular_node* o = allocator::alloc();
+    stats::add(stats::kAllocs);
     o->r = 1;
     o->r |= kTopBit;
     parlay::assign_uninitialized(o->entry, e);
@@ -95,6 +105,11 @@ public:
 
   static node* empty() {return NULL;}
 
+  // Copies the balancing scheme's data of the regular node a to o.
+  static void copy_balance_data(regular_node* o, node* a) {
+    static_cast<balance_data&>(*o) = static_cast<balance_data&>(*cast_to_regular(a));
+  }
+
   inline static ET& get_entry(node* a) { return cast_to_regular(a)->entry; }
   inline static ET* get_entry_p(node* a) { return &(cast_to_regular(a)->entry); }
   static void set_entry(node* a, ET e) { cast_to_regular(a)->entry = e; }
@@ -123,6 +138,7 @@ public:
     } else {
       auto c = cast_to_compressed(a);
       uint8_t* data_start = (((uint8_t*)c) + 3*sizeof(node_size_t));
+      stats::add(stats::kDecodes);
       EntryEncoder::decode(data_start, c->s, f);
     }
   }
@@ -141,7 +157,10 @@ public:
     } else {
       auto c = cast_to_compressed(a);
       uint8_t* data_start = (((uint8_t*)c) + 3*sizeof(node_size_t));
-      return EntryEncoder::decode_cond(data_start, c->s, f);
+      // only a decode that reaches the end of the block counts
+      bool full = EntryEncoder::decode_cond(data_start, c->s, f);
+      if (full) stats::add(stats::kDecodes);
+      return full;
     }
   }
 
@@ -152,6 +171,60 @@ public:
     return EntryEncoder::find(data_start, c->s, f, comp, k);
   }
 
+  // Number of entries in the compressed node b with a key less than k.
+  template <class F, class Comp, class K>
+  static size_t rank_compressed(node* b, const F& f, const Comp& comp, const K& k) {
+    auto c = cast_to_compressed(b);
+    uint8_t* data_start = (((uint8_t*)c) + 3*sizeof(node_size_t));
+    return EntryEncoder::rank(data_start, c->s, f, comp, k);
+  }
+
+  // The i-th entry of the compressed node b (i < size(b)).
+  static ET select_compressed(node* b, size_t i) {
+    auto c = cast_to_compressed(b);
+    uint8_t* data_start = (((uint8_t*)c) + 3*sizeof(node_size_t));
+    return EntryEncoder::select(data_start, c->s, i);
+  }
+
+  // Calls f(E, n) with the n entries of the compressed node a stored in an
+  // array. E is only valid during the call.
+  template <class F>
+  static void decode_block(node* a, const F& f) {
+    auto c = cast_to_compressed(a);
+    uint8_t* data_start = (((uint8_t*)c) + 3*sizeof(node_size_t));
+    stats::add(stats::kDecodes);
+    basic_node_helpers::decode_block<EntryEncoder, ET, 2*B>(data_start, c->s, f);
+  }
+
+  // Writes the keys and values of the compressed node a to keys[0, size(a))
+  // and vals[0, size(a)). vals may be null if only the keys are needed.
+  template <class K, class V>
+  static void decode_columns(node* a, K* keys, V* vals) {
+    auto c = cast_to_compressed(a);
+    uint8_t* data_start = (((uint8_t*)c) + 3*sizeof(node_size_t));
+    stats::add(stats::kDecodes);
+    basic_node_helpers::decode_columns<EntryEncoder>(data_start, c->s, keys, vals);
+  }
+
+  static constexpr bool kBlockSetOps = has_block_set_ops<EntryEncoder>::value;
+
+  // Applies op to the keys of two compressed nodes without decoding them,
+  // if the encoder supports it for these blocks. Writes the resulting keys
+  // to out and returns their number, or -1 if the blocks must be merged
+  // entry by entry.
+  template <class K>
+  static long set_op_compressed(block_set_op op, node* a, node* b, K* out) {
+    if constexpr (kBlockSetOps) {
+      if (!is_compressed(a) || !is_compressed(b)) return -1;
+      auto ca = cast_to_compressed(a), cb = cast_to_compressed(b);
+      return EntryEncoder::set_op(op,
+          ((uint8_t*)ca) + 3*sizeof(node_size_t), ca->s,
+          ((uint8_t*)cb) + 3*sizeof(node_size_t), cb->s, out);
+    } else {
+      return -1;
+    }
+  }
+
   // Used by GC to copy a compressed node. TODO: update to work correctly with
   // diff-encoding.
   static node* make_compressed_node(node* b) {
@@ -194,8 +267,10 @@ public:
 
     size_t encoded_size = EntryEncoder::encoded_size(e, s);
     size_t node_size = sizeof(compressed_node) + encoded_size;
-    compressed_node* c_node = (compressed_node*)utils::new_array_no_init<uint8_t>(node_size);
-    //compressed_node* c_node = (compressed_node*)complex_allocator::alloc();
+    compressed_node* c_node = (compressed_node*)complex_allocator::alloc(node_size);
+    stats::add(stats::kAllocs);
+    stats::add(stats::kEncodes);
+    stats::add(stats::kBytesEncoded, node_size);
 
     c_node->r = 1;
     c_node->s = s;
@@ -229,6 +304,7 @@ public:
     auto f = [&] (const ET& et) {
       parlay::assign_uninitialized(tmp_arr[i++], et);
     };
+    stats::add(stats::kDecodes);
     EntryEncoder::decode(data_start, c->s, f);
     return tmp_arr;
   }
@@ -237,6 +313,7 @@ public:
 
   // Handles both regular and compressed nodes.
   static void free_node(node* va) {
+    stats::add(stats::kFrees);
     if (is_regular(va)) {
       auto a = cast_to_regular(va);
       (a->entry).~ET();
@@ -245,14 +322,18 @@ public:
       auto c = cast_to_compressed(va);
       uint8_t* data_start = (((uint8_t*)c) + 3*sizeof(node_size_t));
       EntryEncoder::destroy(data_start, c->s);
-      auto array_size = c->size_in_bytes;
-      utils::free_array<uint8_t>((uint8_t*)va, array_size);
+      complex_allocator::free(va, c->size_in_bytes);
     }
   }
 
   // precondition: a is non-null, and caller has a reference count on a.
+  // If that is the only reference, no other thread can reach a (increments
+  // are made through a reference), so a is freed without an atomic update;
+  // the acquire load orders the free after earlier releases by other threads.
   static bool decrement_count(node* a) {
-    if ((utils::fetch_and_add(&generic_node(a)->r, -1) & kLowBitMask) == 1) {
+    node_size_t* r = &generic_node(a)->r;
+    if ((__atomic_load_n(r, __ATOMIC_ACQUIRE) & kLowBitMask) == 1 ||
+        (utils::fetch_and_add(r, -1) & kLowBitMask) == 1) {
       free_node(a);
       return true;
     }
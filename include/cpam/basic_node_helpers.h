@@ -3,6 +3,7 @@
 #include <assert.h>
 
 #include "utils.h"
+#include "compression.h"
 
 namespace cpam {
 namespace basic_node_helpers {
@@ -104,7 +105,8 @@ static typename Node::node* make_compressed(typename Node::node* l, typename Nod
   size_t l_s = Node::size(l);
   size_t r_s = Node::size(r);
   size_t tot = l_s + r_s + (e != nullptr);
-  assert(tot >= B);
+  // Fewer than B entries make a single small block, as finalize does.
+  assert(tot > 0);
 
   using ET = typename Node::ET;
   ET stack[7 * B];
@@ -150,5 +152,37 @@ static typename Node::node* make_compressed_node(typename Node::node* b, size_t
   return Node::make_single_compressed_node(stack, offset);
 }
 
+// Calls f(E, n) with the n = size entries of the block at bytes in an array:
+// the block itself if the encoder stores plain entries, and otherwise a
+// buffer of at most kMaxSize entries that the block is decoded into.
+template <class Encoder, class ET, size_t kMaxSize, class F>
+static void decode_block(uint8_t* bytes, size_t size, const F& f) {
+  if constexpr (has_stored_entries<Encoder>::value) {
+    f((const ET*)Encoder::entries(bytes), size);
+  } else {
+    assert(size <= kMaxSize);
+    alignas(64) uint8_t buf[kMaxSize*sizeof(ET)];
+    ET* E = (ET*)buf;
+    size_t i = 0;
+    auto copy_f = [&] (const ET& e) {
+      parlay::assign_uninitialized(E[i++], e);
+    };
+    Encoder::decode(bytes, size, copy_f);
+    f((const ET*)E, size);
+    if constexpr (!std::is_trivially_destructible_v<ET>) {
+      for (size_t j=0; j<size; j++) {
+        E[j].~ET();
+      }
+    }
+  }
+}
+
+template <class Encoder, class K, class V>
+static void decode_columns(uint8_t* bytes, size_t size, K* keys, V* vals) {
+  static_assert(has_decode_columns<Encoder>::value,
+                "the entry encoder does not support decode_columns");
+  Encoder::decode_columns(bytes, size, keys, vals);
+}
+
 }  // namespace basic_node_helpers
 }  // namespace cpam
@@ -17,6 +17,15 @@ struct build {
   template <class Seq>
   static parlay::sequence<ET> sort_remove_duplicates(Seq const &A) { // ?? const
     if (A.size() == 0) return parlay::sequence<ET>(0);
+    // input that is already sorted (e.g. loaded from a file) skips the sort
+    // (the check is spelled out: some parlay versions invert is_sorted)
+    auto out_of_order = parlay::delayed_seq<bool>(A.size() - 1, [&] (size_t i) {
+      return less(A[i+1], A[i]); });
+    if (parlay::count(out_of_order, true) == 0) {
+      auto Fl = parlay::delayed_seq<bool>(A.size(), [&] (size_t i) {
+        return (i==0) || less(A[i-1], A[i]); });
+      return parlay::pack(A, Fl);
+    }
     auto B = parlay::internal::sample_sort(parlay::make_slice(A.begin(),A.end()), less);
 
     auto Fl = parlay::delayed_seq<bool>(B.size(), [&] (size_t i) {
@@ -40,4 +40,25 @@ inline long encodeUnsigned(uint8_t* start, long curOffset, K diff) {
   return curOffset;
 }
 
+// Like encodeUnsigned, but writes a single zero byte for 0, so that any
+// value (not just non-zero differences) can be read back by decodeUnsigned.
+template <class K>
+inline long encodeVarint(uint8_t* start, long curOffset, K val) {
+  do {
+    uint8_t toWrite = val & 0x7f;
+    val = val >> SIZE_PER_BYTE;
+    if (val > 0) toWrite |= 0x80;
+    start[curOffset++] = toWrite;
+  } while (val > 0);
+  return curOffset;
+}
+
+// Number of bytes encodeVarint uses for val.
+template <class K>
+inline size_t varintBytes(K val) {
+  size_t bytes = 1;
+  while (val >>= SIZE_PER_BYTE) bytes++;
+  return bytes;
+}
+
 }  // namespace cpam
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <iostream>
+
+#include "parlay/alloc.h"
+#include "utils.h"
+
+namespace cpam {
+
+// *******************************************
+//   COMPRESSED NODE ALLOCATOR
+// *******************************************
+
+// Size-class arena for the variable-sized compressed nodes of one node type
+// (Tag). Requests of up to kMaxBytes are rounded up to a size class and served
+// from a parlay::block_allocator for that class, which keeps per-thread free
+// lists refilled from (and returned to) a shared pool. Larger requests, e.g.
+// blocks whose encoding grew beyond the plain entries, go to the general
+// allocator.
+//
+// Classes start at kMinBytes and take kStepsPerDoubling evenly spaced sizes
+// per doubling, so a block wastes less than a third of its size, where the
+// power-of-two buckets of the general allocator waste up to half. More
+// classes cut the rounding further but strand memory: blocks freed in one
+// class (e.g. leaves that grew during inserts) cannot serve another.
+template <class Tag, size_t kMaxBytes>
+struct compressed_allocator {
+  static constexpr size_t kMinBytes = 64;
+  static constexpr size_t kLogMinBytes = 6;
+  static constexpr size_t kStepsPerDoubling = 2;
+  static constexpr size_t kLogSteps = 1;
+  // Bytes per list of blocks that a thread takes from or returns to the
+  // shared pool.
+  static constexpr size_t kListBytes = 1 << 18;
+
+  static constexpr size_t class_bytes(size_t i) {
+    size_t base = kMinBytes << (i / kStepsPerDoubling);
+    return base + (i % kStepsPerDoubling) * (base / kStepsPerDoubling);
+  }
+
+  static constexpr size_t num_classes() {
+    size_t i = 0;
+    while (class_bytes(i) < kMaxBytes) i++;
+    return i + 1;
+  }
+
+  static constexpr size_t kNumClasses = num_classes();
+  static constexpr size_t kMaxClassBytes = class_bytes(kNumClasses - 1);
+
+  // The smallest class holding n bytes (n <= kMaxClassBytes).
+  static inline size_t size_class(size_t n) {
+    if (n <= kMinBytes) return 0;
+    size_t k = parlay::log2_up(n) - 1;  // 2^k < n <= 2^(k+1)
+    size_t step_shift = k - kLogSteps;
+    size_t j = ((n - (size_t(1) << k)) + (size_t(1) << step_shift) - 1) >> step_shift;
+    return ((k - kLogMinBytes) << kLogSteps) + j;
+  }
+
+  using pool = parlay::block_allocator;
+
+  static pool** make_pools() {
+    pool** pools = new pool*[kNumClasses];
+    for (size_t i=0; i<kNumClasses; i++) {
+      pools[i] = new pool(class_bytes(i), 0, std::max(kListBytes, 4*class_bytes(i)));
+    }
+    return pools;
+  }
+
+  static inline pool** pools = make_pools();
+  static inline std::atomic<size_t> large_blocks = 0;
+  static inline std::atomic<size_t> large_bytes = 0;
+
+  static inline void* alloc(size_t n) {
+#ifndef PARLAY_USE_STD_ALLOC
+    if (n <= kMaxClassBytes) {
+      return pools[size_class(n)]->alloc();
+    }
+#endif
+    large_blocks.fetch_add(1, std::memory_order_relaxed);
+    large_bytes.fetch_add(n, std::memory_order_relaxed);
+    return utils::new_array_no_init<uint8_t>(n);
+  }
+
+  // n must be the size the block was allocated with.
+  static inline void free(void* p, size_t n) {
+#ifndef PARLAY_USE_STD_ALLOC
+    if (n <= kMaxClassBytes) {
+      pools[size_class(n)]->free(p);
+      return;
+    }
+#endif
+    large_blocks.fetch_sub(1, std::memory_order_relaxed);
+    large_bytes.fetch_sub(n, std::memory_order_relaxed);
+    utils::free_array<uint8_t>((uint8_t*)p, n);
+  }
+
+  // Releases the memory of all classes without live blocks.
+  static void finish() {
+    for (size_t i=0; i<kNumClasses; i++) pools[i]->clear();
+  }
+
+  static size_t num_used_blocks() {
+    size_t ret = large_blocks.load();
+    for (size_t i=0; i<kNumClasses; i++) ret += pools[i]->num_used_blocks();
+    return ret;
+  }
+
+  // Bytes taken by live blocks, including the rounding up to their class.
+  static size_t num_used_bytes() {
+    size_t ret = large_bytes.load();
+    for (size_t i=0; i<kNumClasses; i++) {
+      ret += pools[i]->num_used_blocks() * class_bytes(i);
+    }
+    return ret;
+  }
+
+  // Bytes held by the arena, whether in use or on free lists.
+  static size_t num_allocated_bytes() {
+    size_t ret = large_bytes.load();
+    for (size_t i=0; i<kNumClasses; i++) {
+      ret += pools[i]->num_allocated_blocks() * class_bytes(i);
+    }
+    return ret;
+  }
+
+  static void print_stats() {
+    std::cout << "compressed nodes: used: " << num_used_blocks()
+              << ", used bytes: " << num_used_bytes()
+              << ", allocated bytes: " << num_allocated_bytes()
+              << ", large blocks: " << large_blocks.load() << std::endl;
+    for (size_t i=0; i<kNumClasses; i++) {
+      size_t allocated = pools[i]->num_allocated_blocks();
+      if (allocated == 0) continue;
+      std::cout << "  class " << class_bytes(i) << ": used: "
+                << pools[i]->num_used_blocks() << ", allocated: " << allocated
+                << std::endl;
+    }
+  }
+};
+
+}  // namespace cpam
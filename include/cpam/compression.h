@@ -1,150 +1,1656 @@
 #pragma once
 
+#include <algorithm>
+#include <cstring>
 #include <functional>
 #include <optional>
 #include <tuple>
 #include <type_traits>
+#include <vector>
 
 #include <parlay/primitives.h>
 
+#include "byte_encode.h"
+#include "stream_vbyte.h"
+
 namespace cpam {
 
+// Block-level set operations an encoder may provide (see
+// hybrid_entry_encoder::set_op); used by the base cases of union,
+// intersection and difference.
+enum class block_set_op { union_op, intersect_op, difference_op };
+
+template <class Encoder, class = void>
+struct has_block_set_ops : std::false_type {};
+
+template <class Encoder>
+struct has_block_set_ops<Encoder, std::void_t<decltype(Encoder::has_block_set_ops)>>
+    : std::bool_constant<Encoder::has_block_set_ops> {};
+
+// Optional encoder hooks for decoding a whole block at once:
+//   entries(bytes): the block's entries, if the encoder stores them as a
+//     plain ET array;
+//   decode_columns(bytes, size, K* keys, V* vals): writes the keys and values
+//     of the block to separate arrays; vals may be null if only the keys are
+//     needed.
+template <class Encoder, class = void>
+struct has_stored_entries : std::false_type {};
+
+template <class Encoder>
+struct has_stored_entries<Encoder, std::void_t<decltype(Encoder::entries(nullptr))>>
+    : std::true_type {};
+
+template <class Encoder, class = void>
+struct has_decode_columns : std::false_type {};
+
+template <class Encoder>
+struct has_decode_columns<Encoder, std::void_t<decltype(Encoder::has_decode_columns)>>
+    : std::bool_constant<Encoder::has_decode_columns> {};
+
+// The value column that the key encoders below store in front of the keys:
+// V vals[size] for maps and nothing for sets (entry_t == key_t).
+template <class Entry, bool is_aug>
+struct value_column {
+  using ET = typename Entry::entry_t;
+  using K = typename Entry::key_t;
+  using V = typename Entry::val_t;
+  static constexpr bool kHasVals = !std::is_same_v<ET, K>;
+  static constexpr size_t kValBytes = kHasVals ? sizeof(V) : 0;
+
+  // Stores the values of data and, if is_aug, returns the augmented value
+  // of the block.
+  static inline auto encode(ET* data, size_t size, uint8_t* bytes) {
+    if constexpr (kHasVals) {
+      V* vals = (V*)bytes;
+      for (size_t i=0; i<size; i++) {
+        vals[i] = Entry::get_val(data[i]);
+      }
+    }
+    if constexpr (is_aug) {
+      using AT = typename Entry::aug_t;
+      AT av = Entry::from_entry(data[0]);
+      for (size_t i=1; i<size; i++) {
+        av = Entry::combine(std::move(av), Entry::from_entry(data[i]));
+      }
+      return av;
+    }
+  }
+
+  static inline ET entry(uint8_t* bytes, const K& k, size_t i) {
+    if constexpr (kHasVals) return Entry::to_entry(k, ((V*)bytes)[i]);
+    else return k;
+  }
+
+  template <class F>
+  static inline void update(uint8_t* bytes, const K& k, size_t i, const F& f) {
+    if constexpr (kHasVals) {
+      V* vals = (V*)bytes;
+      vals[i] = f(Entry::to_entry(k, vals[i]));
+    }
+  }
+
+  static inline void copy(uint8_t* bytes, size_t size, V* out) {
+    if constexpr (kHasVals) {
+      if (!out) return;
+      V* vals = (V*)bytes;
+      for (size_t i=0; i<size; i++) {
+        out[i] = vals[i];
+      }
+    }
+  }
+
+  static inline void destroy(uint8_t* bytes, size_t size) {
+    if constexpr (kHasVals) {
+      V* vals = (V*)bytes;
+      for (size_t i=0; i<size; i++) {
+        vals[i].~V();
+      }
+    }
+  }
+};
+
 struct diffencoded_entry_encoder {
 
   struct data {};
 
+  // Every kSkipInterval-th key of a block is stored uncompressed in a small
+  // skip directory together with the byte offset at which the following
+  // differences start. Point queries binary search the directory and only
+  // decode a single sub-run of at most kSkipInterval entries.
+  static constexpr size_t kSkipInterval = 16;
+
+  template <class Entry, bool is_aug = false>
+  struct encoder {
+    using ET = typename Entry::entry_t;
+    using K = typename Entry::key_t;
+    using V = typename Entry::val_t;  // possibly empty (should ensure that default_val in set is empty)
+    using values = value_column<Entry, is_aug>;
+    static constexpr size_t kValBytes = values::kValBytes;
+    static constexpr bool is_trivial = false;  // to test
+
+    // Block layout:
+    //   V vals[size] (maps only) | K first_key | K skip_keys[n_skips] |
+    //   offset skip_offsets[n_skips] | varint differences
+    // where skip_keys[j] is the key at index (j+1)*kSkipInterval and
+    // skip_offsets[j] is the offset of the difference for the entry after it.
+    // The difference stream restarts (is omitted) at every sampled key.
+    static constexpr size_t kMaxKeyBytes = (8*sizeof(K) + 6) / 7;
+
+    static inline size_t num_skips(size_t size) {
+      return (size - 1) / kSkipInterval;
+    }
+
+    // Offsets fit in 16 bits for all practical block sizes (2B <= 6553 for
+    // 64-bit keys); both the encoder and the decoder know the block size, so
+    // no flag is needed to pick the width.
+    static inline bool wide_offsets(size_t size) {
+      return size * kMaxKeyBytes >= (size_t(1) << 16);
+    }
+
+    static inline size_t offset_bytes(size_t size) {
+      return wide_offsets(size) ? sizeof(uint32_t) : sizeof(uint16_t);
+    }
+
+    static inline size_t directory_bytes(size_t size) {
+      return num_skips(size) * (sizeof(K) + offset_bytes(size));
+    }
+
+    static inline K* skip_keys(uint8_t* bytes, size_t size) {
+      return (K*)(bytes + size*kValBytes + sizeof(K));
+    }
+
+    static inline uint8_t* skip_offsets(uint8_t* bytes, size_t size) {
+      return bytes + size*kValBytes + sizeof(K) + num_skips(size)*sizeof(K);
+    }
+
+    static inline uint8_t* diff_bytes(uint8_t* bytes, size_t size) {
+      return bytes + size*kValBytes + sizeof(K) + directory_bytes(size);
+    }
+
+    static inline size_t get_skip_offset(uint8_t* bytes, size_t size, size_t j) {
+      uint8_t* offs = skip_offsets(bytes, size);
+      if (wide_offsets(size)) return ((uint32_t*)offs)[j];
+      return ((uint16_t*)offs)[j];
+    }
+
+    static inline void set_skip_offset(uint8_t* bytes, size_t size, size_t j, size_t off) {
+      uint8_t* offs = skip_offsets(bytes, size);
+      if (wide_offsets(size)) ((uint32_t*)offs)[j] = off;
+      else ((uint16_t*)offs)[j] = off;
+    }
+
+    // Key at the start of sub-run j (j = 0 is the first key of the block).
+    static inline K run_key(uint8_t* bytes, size_t size, size_t j) {
+      if (j == 0) return *((K*)(bytes + size*kValBytes));
+      return skip_keys(bytes, size)[j-1];
+    }
+
+    // Pointer to the first difference of sub-run j.
+    static inline uint8_t* run_start(uint8_t* bytes, size_t size, size_t j) {
+      uint8_t* diffs = diff_bytes(bytes, size);
+      if (j == 0) return diffs;
+      return diffs + get_skip_offset(bytes, size, j-1);
+    }
+
+    // Index of the last sub-run whose first key is <= k (when le = true) or
+    // < k (when le = false). Returns -1 if there is no such sub-run.
+    template <class Comp, class Key>
+    static inline long find_run(uint8_t* bytes, size_t size, const Comp& comp,
+                                const Key& k, bool le) {
+      auto before = [&] (const K& rk) {
+        return le ? !comp(k, rk) : comp(rk, k);
+      };
+      if (!before(run_key(bytes, size, 0))) return -1;
+      K* sk = skip_keys(bytes, size);
+      size_t lo = 0, hi = num_skips(size);  // sk[0, lo) satisfy before
+      while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (before(sk[mid])) lo = mid + 1;
+        else hi = mid;
+      }
+      return lo;
+    }
+
+    static inline void print_info(const ET& et) {
+    }
+
+    static inline size_t encoded_size(ET* data, size_t size) {
+      uint8_t stk[2*sizeof(K)];
+      assert(size > 0);
+      K prev_key = Entry::get_key(data[0]);
+      size_t key_bytes = sizeof(K);  // first key is uncompressed
+      for (size_t i=1; i<size; i++) {
+        K cur_key = Entry::get_key(data[i]);
+        if (i % kSkipInterval != 0) {
+          K next_diff = cur_key - prev_key;
+          auto bytes_used = encodeUnsigned<K>((uint8_t*)stk, 0, next_diff);  // compressed difference
+          key_bytes += bytes_used;
+        }
+        prev_key = cur_key;
+      }
+      size_t val_bytes = size*kValBytes;
+      return key_bytes + directory_bytes(size) + val_bytes;
+    }
+
+    static inline void encode_keys(ET* data, size_t size, uint8_t* bytes) {
+      K prev_key = Entry::get_key(data[0]);
+      *((K*)(bytes + size*kValBytes)) = prev_key;  // store first key
+      K* sk = skip_keys(bytes, size);
+      uint8_t* diffs = diff_bytes(bytes, size);
+      size_t offset = 0;
+      for (size_t i=1; i<size; i++) {
+        K cur_key = Entry::get_key(data[i]);
+        if (i % kSkipInterval == 0) {
+          size_t j = i / kSkipInterval - 1;
+          sk[j] = cur_key;
+          set_skip_offset(bytes, size, j, offset);
+        } else {
+          K next_diff = cur_key - prev_key;
+          offset = encodeUnsigned<K>(diffs, offset, next_diff);  // compressed difference
+        }
+        prev_key = cur_key;
+      }
+    }
+
+    static inline auto encode(ET* data, size_t size, uint8_t* bytes) {
+      encode_keys(data, size, bytes);
+
+      return values::encode(data, size, bytes);
+    }
+
+    // Calls f(key, i) on the keys of entries run*kSkipInterval, ..., size-1,
+    // in order. f returns false to stop.
+    template <class F>
+    static inline bool decode_keys_cond(uint8_t* bytes, size_t size,
+                                        size_t run, const F& f) {
+      size_t i = run * kSkipInterval;
+      uint8_t* key_bytes = run_start(bytes, size, run);
+      K cur_key = run_key(bytes, size, run);
+      if (!f(cur_key, i)) return false;
+      K* sk = skip_keys(bytes, size);
+      for (i=i+1; i<size; i++) {
+        if (i % kSkipInterval == 0) {
+          cur_key = sk[i / kSkipInterval - 1];
+        } else {
+          cur_key += decodeUnsigned<K>(key_bytes);
+        }
+        if (!f(cur_key, i)) return false;
+      }
+      return true;
+    }
+
+    template <class F>
+    static inline void decode(uint8_t* bytes, size_t size, const F& f) {
+      auto g = [&] (const K& k, size_t i) {
+        f(values::entry(bytes, k, i));
+        return true;
+      };
+      decode_keys_cond(bytes, size, 0, g);
+    }
+
+    static constexpr bool has_decode_columns = true;
+    static inline void decode_columns(uint8_t* bytes, size_t size,
+                                      K* keys, typename values::V* vals) {
+      auto g = [&] (const K& k, size_t i) {
+        keys[i] = k;
+        return true;
+      };
+      decode_keys_cond(bytes, size, 0, g);
+      values::copy(bytes, size, vals);
+    }
+
+    template <class F>
+    static inline void inplace_update(uint8_t* bytes, size_t size, const F& f) {
+      auto g = [&] (const K& k, size_t i) {
+        values::update(bytes, k, i, f);
+        return true;
+      };
+      decode_keys_cond(bytes, size, 0, g);
+    }
+
+    template <class F>
+    static inline bool decode_cond(uint8_t* bytes, uint32_t size, const F& f) {
+      auto g = [&] (const K& k, size_t i) {
+        return f(values::entry(bytes, k, i));
+      };
+      return decode_keys_cond(bytes, size, 0, g);
+    }
+
+    // F: ET -> K
+    template <class F, class Comp, class Key>
+    static inline std::optional<ET> find(uint8_t* bytes, size_t size,
+          const F& f, const Comp& comp, const Key& k) {
+      std::optional<ET> ret;
+      long run = find_run(bytes, size, comp, k, /* le = */ true);
+      if (run < 0) return ret;
+      auto test = [&] (const K& key, size_t i) -> bool {
+        if (comp(key, k)) return true;
+        if (!comp(k, key)) ret = values::entry(bytes, key, i);
+        return false;
+      };
+      decode_keys_cond(bytes, size, run, test);
+      return ret;
+    }
+
+    // Number of entries whose key is less than k.
+    template <class F, class Comp, class Key>
+    static inline size_t rank(uint8_t* bytes, size_t size,
+          const F& f, const Comp& comp, const Key& k) {
+      long run = find_run(bytes, size, comp, k, /* le = */ false);
+      if (run < 0) return 0;
+      size_t ret = run * kSkipInterval;
+      auto count = [&] (const K& key, size_t i) -> bool {
+        if (!comp(key, k)) return false;
+        ret = i + 1;
+        return true;
+      };
+      decode_keys_cond(bytes, size, run, count);
+      return ret;
+    }
+
+    // The i-th entry of the block (i < size); decodes only its sub-run.
+    static inline ET select(uint8_t* bytes, size_t size, size_t i) {
+      K ret;
+      auto get = [&] (const K& key, size_t j) -> bool {
+        ret = key;
+        return j < i;
+      };
+      decode_keys_cond(bytes, size, i / kSkipInterval, get);
+      return values::entry(bytes, ret, i);
+    }
+
+    static inline void destroy(uint8_t* bytes, size_t size) {
+      values::destroy(bytes, size);
+    }
+  };
+};
+
+// Delta coding like diffencoded_entry_encoder, but with the differences laid
+// out as a Stream-VByte stream (see stream_vbyte.h) so that scans decode a
+// group of keys per shuffle instead of one byte per iteration. Keys must be
+// unsigned integers of at most 64 bits.
+struct streamvbyte_entry_encoder {
+
+  struct data {};
+
+  // Keys are decoded into a stack buffer of this many keys at a time.
+  static constexpr size_t kDecodeChunk = 64;
+
+  template <class Entry, bool is_aug = false>
+  struct encoder {
+    using ET = typename Entry::entry_t;
+    using K = typename Entry::key_t;
+    using V = typename Entry::val_t;
+    using values = value_column<Entry, is_aug>;
+    static constexpr size_t kValBytes = values::kValBytes;
+    using L = std::conditional_t<(sizeof(K) <= 4), uint32_t, uint64_t>;
+    using svb = stream_vbyte<L>;
+    static_assert(std::is_integral_v<K> && std::is_unsigned_v<K> && sizeof(K) <= 8,
+                  "streamvbyte_entry_encoder requires unsigned integer keys");
+    static constexpr bool is_trivial = false;
+
+    // Block layout:
+    //   V vals[size] (maps only) | K first_key | uint32_t data_len |
+    //   uint8_t control[(size-1+3)/4] | data[data_len]
+    // where the control and data streams hold the size-1 differences.
+    static inline K first_key(uint8_t* bytes, size_t size) {
+      return *((K*)(bytes + size*kValBytes));
+    }
+
+    static inline uint32_t* data_len(uint8_t* bytes, size_t size) {
+      return (uint32_t*)(bytes + size*kValBytes + sizeof(K));
+    }
+
+    static inline uint8_t* control(uint8_t* bytes, size_t size) {
+      return bytes + size*kValBytes + sizeof(K) + sizeof(uint32_t);
+    }
+
+    static inline uint8_t* data_start(uint8_t* bytes, size_t size) {
+      return control(bytes, size) + svb::control_bytes(size - 1);
+    }
+
+    static inline void print_info(const ET& et) {
+    }
+
+    static inline size_t encoded_size(ET* data, size_t size) {
+      assert(size > 0);
+      size_t data_bytes = 0;
+      K prev_key = Entry::get_key(data[0]);
+      for (size_t i=1; i<size; i++) {
+        K cur_key = Entry::get_key(data[i]);
+        data_bytes += svb::data_bytes(L(cur_key - prev_key));
+        prev_key = cur_key;
+      }
+      return size*kValBytes + sizeof(K) + sizeof(uint32_t)
+             + svb::control_bytes(size - 1) + data_bytes;
+    }
+
+    static inline auto encode(ET* data, size_t size, uint8_t* bytes) {
+      K prev_key = Entry::get_key(data[0]);
+      *((K*)(bytes + size*kValBytes)) = prev_key;
+      uint8_t* ctrl = control(bytes, size);
+      uint8_t* diffs = data_start(bytes, size);
+      std::memset(ctrl, 0, svb::control_bytes(size - 1));
+      size_t offset = 0;
+      for (size_t i=1; i<size; i++) {
+        K cur_key = Entry::get_key(data[i]);
+        offset += svb::put(ctrl, diffs + offset, i-1, L(cur_key - prev_key));
+        prev_key = cur_key;
+      }
+      *data_len(bytes, size) = offset;
+
+      return values::encode(data, size, bytes);
+    }
+
+    // Calls f(key, i) on the keys of all entries in order, decoding
+    // kDecodeChunk keys at a time. f returns false to stop.
+    template <class F>
+    static inline bool decode_keys_cond(uint8_t* bytes, size_t size, const F& f) {
+      K prev_key = first_key(bytes, size);
+      if (!f(prev_key, 0)) return false;
+      uint8_t* ctrl = control(bytes, size);
+      uint8_t* diffs = data_start(bytes, size);
+      uint8_t* end = diffs + *data_len(bytes, size);
+      L buf[kDecodeChunk];
+      for (size_t i=1; i<size; i += kDecodeChunk) {
+        size_t n = std::min(kDecodeChunk, size - i);
+        svb::decode_prefix(ctrl, diffs, end, n, L(prev_key), buf);
+        for (size_t j=0; j<n; j++) {
+          if (!f(K(buf[j]), i+j)) return false;
+        }
+        prev_key = K(buf[n-1]);
+      }
+      return true;
+    }
+
+    template <class F>
+    static inline void decode(uint8_t* bytes, size_t size, const F& f) {
+      auto g = [&] (const K& k, size_t i) {
+        f(values::entry(bytes, k, i));
+        return true;
+      };
+      decode_keys_cond(bytes, size, g);
+    }
+
+    static constexpr bool has_decode_columns = true;
+    static inline void decode_columns(uint8_t* bytes, size_t size,
+                                      K* keys, typename values::V* vals) {
+      auto g = [&] (const K& k, size_t i) {
+        keys[i] = k;
+        return true;
+      };
+      decode_keys_cond(bytes, size, g);
+      values::copy(bytes, size, vals);
+    }
+
+    template <class F>
+    static inline void inplace_update(uint8_t* bytes, size_t size, const F& f) {
+      auto g = [&] (const K& k, size_t i) {
+        values::update(bytes, k, i, f);
+        return true;
+      };
+      decode_keys_cond(bytes, size, g);
+    }
+
+    template <class F>
+    static inline bool decode_cond(uint8_t* bytes, uint32_t size, const F& f) {
+      auto g = [&] (const K& k, size_t i) {
+        return f(values::entry(bytes, k, i));
+      };
+      return decode_keys_cond(bytes, size, g);
+    }
+
+    // F: ET -> K
+    template <class F, class Comp, class Key>
+    static inline std::optional<ET> find(uint8_t* bytes, size_t size,
+          const F& f, const Comp& comp, const Key& k) {
+      std::optional<ET> ret;
+      if (comp(k, first_key(bytes, size))) return ret;
+      auto test = [&] (const K& key, size_t i) -> bool {
+        if (comp(key, k)) return true;
+        if (!comp(k, key)) ret = values::entry(bytes, key, i);
+        return false;
+      };
+      decode_keys_cond(bytes, size, test);
+      return ret;
+    }
+
+    // Number of entries whose key is less than k.
+    template <class F, class Comp, class Key>
+    static inline size_t rank(uint8_t* bytes, size_t size,
+          const F& f, const Comp& comp, const Key& k) {
+      size_t ret = 0;
+      auto count = [&] (const K& key, size_t i) -> bool {
+        if (!comp(key, k)) return false;
+        ret = i + 1;
+        return true;
+      };
+      decode_keys_cond(bytes, size, count);
+      return ret;
+    }
+
+    // The i-th entry of the block (i < size).
+    static inline ET select(uint8_t* bytes, size_t size, size_t i) {
+      K ret;
+      auto get = [&] (const K& key, size_t j) -> bool {
+        ret = key;
+        return j < i;
+      };
+      decode_keys_cond(bytes, size, get);
+      return values::entry(bytes, ret, i);
+    }
+
+    static inline void destroy(uint8_t* bytes, size_t size) {
+      values::destroy(bytes, size);
+    }
+  };
+};
+
+// Frame-of-reference coding: the i-th key of a block is stored as its offset
+// from the line base + i*step through the first and last keys, packed at the
+// bit width that minimizes the block size. Offsets that do not fit are stored
+// separately as full keys (PFor exceptions). Unlike the delta encoders, the
+// i-th key can be read without decoding its predecessors, so find, rank and
+// select binary search the block directly. Keys must be unsigned integers of
+// at most 64 bits.
+struct bitpacked_entry_encoder {
+
+  struct data {};
+
+  template <class Entry, bool is_aug = false>
+  struct encoder {
+    using ET = typename Entry::entry_t;
+    using K = typename Entry::key_t;
+    using V = typename Entry::val_t;
+    using values = value_column<Entry, is_aug>;
+    static constexpr size_t kValBytes = values::kValBytes;
+    static_assert(std::is_integral_v<K> && std::is_unsigned_v<K> && sizeof(K) <= 8,
+                  "bitpacked_entry_encoder requires unsigned integer keys");
+    static constexpr bool is_trivial = false;
+
+    // Block layout:
+    //   V vals[size] (maps only) | header | uint64_t words[num_words] |
+    //   uint32_t exc_idx[n_exc] | K exc_keys[n_exc]
+    // key_i = base + i*step + offset_i - neg, where offset_i is stored in
+    // words at bits [i*width, (i+1)*width). An offset of all ones marks an
+    // exception whose key is found by binary searching exc_idx.
+    struct header {
+      K base;
+      K step;
+      K neg;
+      uint32_t n_exc;
+      uint8_t width;
+    };
+
+    static constexpr size_t kExceptionBits = 8*(sizeof(uint32_t) + sizeof(K));
+
+    static inline uint64_t width_mask(size_t w) {
+      return (w == 64) ? ~uint64_t(0) : ((uint64_t(1) << w) - 1);
+    }
+
+    static inline size_t num_words(size_t size, size_t w) {
+      return (size * w + 63) / 64;
+    }
+
+    static inline header get_header(uint8_t* bytes, size_t size) {
+      header h;
+      std::memcpy(&h, bytes + size*kValBytes, sizeof(header));
+      return h;
+    }
+
+    static inline uint8_t* words(uint8_t* bytes, size_t size) {
+      return bytes + size*kValBytes + sizeof(header);
+    }
+
+    static inline uint8_t* exc_idx(uint8_t* bytes, size_t size, const header& h) {
+      return words(bytes, size) + num_words(size, h.width)*sizeof(uint64_t);
+    }
+
+    static inline uint8_t* exc_keys(uint8_t* bytes, size_t size, const header& h) {
+      return exc_idx(bytes, size, h) + h.n_exc*sizeof(uint32_t);
+    }
+
+    template <class T>
+    static inline T load(uint8_t* p, size_t i) {
+      T v;
+      std::memcpy(&v, p + i*sizeof(T), sizeof(T));
+      return v;
+    }
+
+    template <class T>
+    static inline void store(uint8_t* p, size_t i, T v) {
+      std::memcpy(p + i*sizeof(T), &v, sizeof(T));
+    }
+
+    // Offset of key i from base + i*step (plus neg). Both the step and the
+    // offsets use wrap-around arithmetic in uint64_t.
+    static inline uint64_t offset_of(ET* data, const header& h, size_t i) {
+      return uint64_t(Entry::get_key(data[i])) - uint64_t(h.base)
+             - i*uint64_t(h.step) + uint64_t(h.neg);
+    }
+
+    // Picks base, step, neg and the width minimizing size*width bits plus the
+    // cost of the exceptions.
+    static inline header plan(ET* data, size_t size) {
+      header h;
+      h.base = Entry::get_key(data[0]);
+      uint64_t range = uint64_t(Entry::get_key(data[size-1])) - uint64_t(h.base);
+      // Offsets below the line are negative; they are only guaranteed to fit
+      // in an int64_t if the range does.
+      h.step = (size > 1 && range < (uint64_t(1) << 63)) ? range / (size - 1) : 0;
+      h.neg = 0;
+      int64_t min_off = 0;
+      if (h.step > 0) {
+        for (size_t i=1; i<size; i++) {
+          min_off = std::min(min_off, (int64_t)offset_of(data, h, i));
+        }
+      }
+      h.neg = K(-min_off);
+
+      // cnt[b]: offsets of bit length b; ones[b]: those equal to 2^b - 1,
+      // which are exceptions at width b.
+      size_t cnt[65] = {}, ones[65] = {};
+      for (size_t i=0; i<size; i++) {
+        uint64_t off = offset_of(data, h, i);
+        size_t b = (off == 0) ? 0 : 64 - __builtin_clzll(off);
+        cnt[b]++;
+        if ((off & (off + 1)) == 0) ones[b]++;
+      }
+      size_t best_w = 64, best_exc = ones[64];
+      size_t best_cost = size*64 + best_exc*kExceptionBits;
+      size_t above = cnt[64];  // offsets longer than w
+      for (size_t w=63; w>=1; w--) {
+        size_t exc = above + ones[w];
+        size_t cost = size*w + exc*kExceptionBits;
+        if (cost <= best_cost) { best_w = w; best_exc = exc; best_cost = cost; }
+        above += cnt[w];
+      }
+      if (above == 0) { best_w = 0; best_exc = 0; }  // all offsets are zero
+      h.width = best_w;
+      h.n_exc = best_exc;
+      return h;
+    }
+
+    static inline void print_info(const ET& et) {
+    }
+
+    static inline size_t encoded_size(ET* data, size_t size) {
+      assert(size > 0);
+      header h = plan(data, size);
+      return size*kValBytes + sizeof(header)
+             + num_words(size, h.width)*sizeof(uint64_t)
+             + h.n_exc*(sizeof(uint32_t) + sizeof(K));
+    }
+
+    static inline auto encode(ET* data, size_t size, uint8_t* bytes) {
+      header h = plan(data, size);
+      std::memcpy(bytes + size*kValBytes, &h, sizeof(header));
+      uint8_t* w = words(bytes, size);
+      uint8_t* ei = exc_idx(bytes, size, h);
+      uint8_t* ek = exc_keys(bytes, size, h);
+      std::memset(w, 0, num_words(size, h.width)*sizeof(uint64_t));
+      if (h.width > 0) {
+        uint64_t mask = width_mask(h.width);
+        size_t e = 0;
+        for (size_t i=0; i<size; i++) {
+          uint64_t off = offset_of(data, h, i);
+          if (off >= mask) {
+            store<uint32_t>(ei, e, i);
+            store<K>(ek, e, Entry::get_key(data[i]));
+            e++;
+            off = mask;
+          }
+          size_t bit = i*h.width, wi = bit / 64, sh = bit % 64;
+          store<uint64_t>(w, wi, load<uint64_t>(w, wi) | (off << sh));
+          if (sh + h.width > 64) {
+            store<uint64_t>(w, wi+1, load<uint64_t>(w, wi+1) | (off >> (64 - sh)));
+          }
+        }
+        assert(e == h.n_exc);
+      }
+
+      return values::encode(data, size, bytes);
+    }
+
+    // The key of entry i, in O(1) (O(log n_exc) for an exception).
+    static inline K key_at(uint8_t* bytes, size_t size, const header& h, size_t i) {
+      uint64_t off = 0;
+      if (h.width > 0) {
+        uint8_t* w = words(bytes, size);
+        size_t bit = i*h.width, wi = bit / 64, sh = bit % 64;
+        off = load<uint64_t>(w, wi) >> sh;
+        if (sh + h.width > 64) off |= load<uint64_t>(w, wi+1) << (64 - sh);
+        uint64_t mask = width_mask(h.width);
+        off &= mask;
+        if (off == mask) {
+          uint8_t* ei = exc_idx(bytes, size, h);
+          size_t lo = 0, hi = h.n_exc;  // exc_idx[lo] == i
+          while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (load<uint32_t>(ei, mid) < i) lo = mid + 1;
+            else hi = mid;
+          }
+          return load<K>(exc_keys(bytes, size, h), lo);
+        }
+      }
+      return K(uint64_t(h.base) + i*uint64_t(h.step) + off - uint64_t(h.neg));
+    }
+
+    // First index whose key is not less than k.
+    template <class Comp, class Key>
+    static inline size_t lower_bound(uint8_t* bytes, size_t size,
+                                     const header& h, const Comp& comp, const Key& k) {
+      size_t lo = 0, hi = size;
+      while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (comp(key_at(bytes, size, h, mid), k)) lo = mid + 1;
+        else hi = mid;
+      }
+      return lo;
+    }
+
+    // Sequential unpacking; exceptions are consumed in order rather than
+    // searched for.
+    template <class F>
+    static inline bool decode_keys_cond(uint8_t* bytes, size_t size, const F& f) {
+      header h = get_header(bytes, size);
+      uint64_t cur = uint64_t(h.base) - uint64_t(h.neg);
+      if (h.width == 0) {
+        for (size_t i=0; i<size; i++, cur += h.step) {
+          if (!f(K(cur), i)) return false;
+        }
+        return true;
+      }
+      uint8_t* w = words(bytes, size);
+      uint8_t* ek = exc_keys(bytes, size, h);
+      uint64_t mask = width_mask(h.width);
+      size_t e = 0, sh = 0, wi = 0;
+      uint64_t word = load<uint64_t>(w, 0);
+      for (size_t i=0; i<size; i++, cur += h.step) {
+        uint64_t off = word >> sh;
+        sh += h.width;
+        if (sh >= 64) {
+          sh -= 64;
+          if (++wi < num_words(size, h.width)) {
+            word = load<uint64_t>(w, wi);
+            if (sh > 0) off |= word << (h.width - sh);
+          }
+        }
+        off &= mask;
+        K key = (off == mask) ? load<K>(ek, e++) : K(cur + off);
+        if (!f(key, i)) return false;
+      }
+      return true;
+    }
+
+    template <class F>
+    static inline void decode(uint8_t* bytes, size_t size, const F& f) {
+      auto g = [&] (const K& k, size_t i) {
+        f(values::entry(bytes, k, i));
+        return true;
+      };
+      decode_keys_cond(bytes, size, g);
+    }
+
+    static constexpr bool has_decode_columns = true;
+    static inline void decode_columns(uint8_t* bytes, size_t size,
+                                      K* keys, typename values::V* vals) {
+      auto g = [&] (const K& k, size_t i) {
+        keys[i] = k;
+        return true;
+      };
+      decode_keys_cond(bytes, size, g);
+      values::copy(bytes, size, vals);
+    }
+
+    template <class F>
+    static inline void inplace_update(uint8_t* bytes, size_t size, const F& f) {
+      auto g = [&] (const K& k, size_t i) {
+        values::update(bytes, k, i, f);
+        return true;
+      };
+      decode_keys_cond(bytes, size, g);
+    }
+
+    template <class F>
+    static inline bool decode_cond(uint8_t* bytes, uint32_t size, const F& f) {
+      auto g = [&] (const K& k, size_t i) {
+        return f(values::entry(bytes, k, i));
+      };
+      return decode_keys_cond(bytes, size, g);
+    }
+
+    // F: ET -> K
+    template <class F, class Comp, class Key>
+    static inline std::optional<ET> find(uint8_t* bytes, size_t size,
+          const F& f, const Comp& comp, const Key& k) {
+      header h = get_header(bytes, size);
+      size_t i = lower_bound(bytes, size, h, comp, k);
+      if (i < size) {
+        K key = key_at(bytes, size, h, i);
+        if (!comp(k, key)) return values::entry(bytes, key, i);
+      }
+      return std::nullopt;
+    }
+
+    // Number of entries whose key is less than k.
+    template <class F, class Comp, class Key>
+    static inline size_t rank(uint8_t* bytes, size_t size,
+          const F& f, const Comp& comp, const Key& k) {
+      return lower_bound(bytes, size, get_header(bytes, size), comp, k);
+    }
+
+    static inline ET select(uint8_t* bytes, size_t size, size_t i) {
+      header h = get_header(bytes, size);
+      return values::entry(bytes, key_at(bytes, size, h, i), i);
+    }
+
+    static inline void destroy(uint8_t* bytes, size_t size) {
+      values::destroy(bytes, size);
+    }
+  };
+};
+
+// Hybrid encoding for integer keys with long runs of consecutive values.
+// Every block is stored in whichever of three forms is smallest for it:
+//   - runs:   the maximal ranges of consecutive keys (Roaring run container),
+//   - bitmap: one bit per key between the first and the last key,
+//   - delta:  the first key followed by varint differences.
+// For sets, set_op combines two blocks of the same run or bitmap form with
+// interval or word operations instead of merging decoded entries. Keys must
+// be unsigned integers compared in their natural order; for sets no values
+// are stored.
+struct hybrid_entry_encoder {
+
+  struct data {};
+
+  enum form : uint8_t { kRuns = 0, kBitmap = 1, kDelta = 2 };
+
   template <class Entry, bool is_aug = false>
   struct encoder {
     using ET = typename Entry::entry_t;
     using K = typename Entry::key_t;
-    using V = typename Entry::val_t;  // possibly empty (should ensure that default_val in set is empty)
-    static constexpr bool is_trivial = false;  // to test
+    using V = typename Entry::val_t;
+    static_assert(std::is_integral_v<K> && std::is_unsigned_v<K>,
+                  "hybrid_entry_encoder requires unsigned integer keys");
+    static constexpr bool is_trivial = false;
+    static constexpr bool has_block_set_ops = true;
+    using values = value_column<Entry, is_aug>;
+    static constexpr bool kHasVals = values::kHasVals;
+    static constexpr size_t kValBytes = values::kValBytes;
+
+    // Block layout: V vals[size] (maps only) | uint8_t form | payload, where
+    // the payload is
+    //   runs:   uint32_t n_runs | K starts[n_runs] | uint32_t ends[n_runs]
+    //   bitmap: K base | uint32_t n_words | uint64_t words[n_words]
+    //   delta:  K first_key | varint differences
+    // ends[r] is the index one past the last entry of run r, and base is the
+    // first key rounded down to a multiple of 64.
+
+    template <class T>
+    static inline T load(uint8_t* p, size_t i) {
+      T v;
+      std::memcpy(&v, p + i*sizeof(T), sizeof(T));
+      return v;
+    }
+
+    template <class T>
+    static inline void store(uint8_t* p, size_t i, T v) {
+      std::memcpy(p + i*sizeof(T), &v, sizeof(T));
+    }
+
+    static inline size_t varint_bytes(K d) {
+      size_t b = (d == 0) ? 1 : 8*sizeof(unsigned long long) - __builtin_clzll(d);
+      return (b + SIZE_PER_BYTE - 1) / SIZE_PER_BYTE;
+    }
+
+    static inline uint8_t* form_p(uint8_t* bytes, size_t size) {
+      return bytes + size*kValBytes;
+    }
+
+    static inline uint8_t* payload(uint8_t* bytes, size_t size) {
+      return form_p(bytes, size) + 1;
+    }
+
+    struct plan_t {
+      form f;
+      size_t n_runs;
+      size_t n_words;
+      size_t payload_bytes;
+    };
+
+    static inline plan_t plan(ET* data, size_t size) {
+      K first = Entry::get_key(data[0]), last = Entry::get_key(data[size-1]);
+      size_t n_runs = 1, delta_bytes = sizeof(K);
+      for (size_t i=1; i<size; i++) {
+        K d = Entry::get_key(data[i]) - Entry::get_key(data[i-1]);
+        n_runs += (d != 1);
+        delta_bytes += varint_bytes(d);
+      }
+      size_t run_bytes = sizeof(uint32_t) + n_runs*(sizeof(K) + sizeof(uint32_t));
+      plan_t p{kRuns, n_runs, 0, run_bytes};
+      // Only consider a bitmap if it can be smaller than one byte per key.
+      K base = first & ~K(63);
+      size_t span_words = size_t(K(last - base)) >> 6;
+      if (span_words < size) {
+        size_t n_words = span_words + 1;
+        size_t bitmap_bytes = sizeof(K) + sizeof(uint32_t) + n_words*sizeof(uint64_t);
+        if (bitmap_bytes < p.payload_bytes) p = {kBitmap, n_runs, n_words, bitmap_bytes};
+      }
+      if (delta_bytes < p.payload_bytes) p = {kDelta, n_runs, 0, delta_bytes};
+      return p;
+    }
 
     static inline void print_info(const ET& et) {
     }
 
     static inline size_t encoded_size(ET* data, size_t size) {
-      uint8_t stk[2*sizeof(K)];
       assert(size > 0);
-      K prev_key = Entry::get_key(data[0]);
-      size_t key_bytes = sizeof(K);  // first key is uncompressed
-      for (size_t i=0; i<size; i++) {
-        K cur_key = Entry::get_key(data[i]);
-        K next_diff = cur_key - prev_key;
-        auto bytes_used = encodeUnsigned<K>((uint8_t*)stk, 0, next_diff);  // compressed difference
-        key_bytes += bytes_used;
-        prev_key = cur_key;
-      }
-      size_t val_bytes = size * sizeof(V);
-      return key_bytes + val_bytes;
+      return size*kValBytes + 1 + plan(data, size).payload_bytes;
     }
 
     static inline auto encode(ET* data, size_t size, uint8_t* bytes) {
-      V* vals = (V*)bytes;
-      uint8_t* key_bytes = (bytes + size*sizeof(V));
-
-      if constexpr (is_aug) {
-        using AT = typename Entry::aug_t;
-        AT av = Entry::from_entry(data[0]);
-        K prev_key = Entry::get_key(data[0]);
-        *((K*)key_bytes) = prev_key;  // store first key
-        vals[0] = Entry::get_val(data[0]);
-        size_t offset = sizeof(K);  // first key is uncompressed
+      plan_t p = plan(data, size);
+      *form_p(bytes, size) = p.f;
+      uint8_t* pl = payload(bytes, size);
+      if (p.f == kRuns) {
+        store<uint32_t>(pl, 0, p.n_runs);
+        uint8_t* starts = pl + sizeof(uint32_t);
+        uint8_t* ends = starts + p.n_runs*sizeof(K);
+        size_t r = 0;
+        store<K>(starts, 0, Entry::get_key(data[0]));
         for (size_t i=1; i<size; i++) {
-          vals[i] = Entry::get_val(data[i]);
-          K cur_key = Entry::get_key(data[i]);
-          K next_diff = cur_key - prev_key;
-          offset = encodeUnsigned<K>(key_bytes, offset, next_diff);  // compressed difference
-          prev_key = cur_key;
-          av = Entry::combine(std::move(av), Entry::from_entry(data[i]));
+          if (Entry::get_key(data[i]) - Entry::get_key(data[i-1]) != 1) {
+            store<uint32_t>(ends, r, i);
+            store<K>(starts, ++r, Entry::get_key(data[i]));
+          }
+        }
+        store<uint32_t>(ends, r, size);
+      } else if (p.f == kBitmap) {
+        K base = Entry::get_key(data[0]) & ~K(63);
+        store<K>(pl, 0, base);
+        store<uint32_t>(pl + sizeof(K), 0, p.n_words);
+        uint8_t* words = pl + sizeof(K) + sizeof(uint32_t);
+        std::memset(words, 0, p.n_words*sizeof(uint64_t));
+        for (size_t i=0; i<size; i++) {
+          K off = Entry::get_key(data[i]) - base;
+          store<uint64_t>(words, off >> 6,
+                          load<uint64_t>(words, off >> 6) | (uint64_t(1) << (off & 63)));
         }
-        return av;
       } else {
-        K prev_key = Entry::get_key(data[0]);
-        *((K*)key_bytes) = prev_key;  // store first key
-        vals[0] = Entry::get_val(data[0]);
-        size_t offset = sizeof(K);  // first key is uncompressed
+        store<K>(pl, 0, Entry::get_key(data[0]));
+        uint8_t* diffs = pl + sizeof(K);
+        long offset = 0;
         for (size_t i=1; i<size; i++) {
-          vals[i] = Entry::get_val(data[i]);
-          K cur_key = Entry::get_key(data[i]);
-          K next_diff = cur_key - prev_key;
-          offset = encodeUnsigned<K>(key_bytes, offset, next_diff);  // compressed difference
-          prev_key = cur_key;
+          offset = encodeUnsigned<K>(diffs, offset,
+                                     Entry::get_key(data[i]) - Entry::get_key(data[i-1]));
+        }
+      }
+      return values::encode(data, size, bytes);
+    }
+
+    // Views of the run and bitmap payloads.
+    struct runs_t {
+      size_t n;
+      uint8_t* starts;
+      uint8_t* ends;
+      K start(size_t r) const { return load<K>(starts, r); }
+      size_t end(size_t r) const { return load<uint32_t>(ends, r); }
+      size_t begin(size_t r) const { return r == 0 ? 0 : end(r-1); }
+      K last(size_t r) const { return start(r) + (end(r) - begin(r) - 1); }
+    };
+
+    static inline runs_t get_runs(uint8_t* bytes, size_t size) {
+      uint8_t* pl = payload(bytes, size);
+      size_t n = load<uint32_t>(pl, 0);
+      uint8_t* starts = pl + sizeof(uint32_t);
+      return runs_t{n, starts, starts + n*sizeof(K)};
+    }
+
+    struct bitmap_t {
+      K base;
+      size_t n_words;
+      uint8_t* words;
+      uint64_t word(size_t w) const { return load<uint64_t>(words, w); }
+      // Word covering the keys [64*w_abs, 64*w_abs + 64), zero if outside.
+      uint64_t word_at(uint64_t w_abs) const {
+        uint64_t w0 = base >> 6;
+        return (w_abs >= w0 && w_abs - w0 < n_words) ? word(w_abs - w0) : 0;
+      }
+    };
+
+    static inline bitmap_t get_bitmap(uint8_t* bytes, size_t size) {
+      uint8_t* pl = payload(bytes, size);
+      return bitmap_t{load<K>(pl, 0), load<uint32_t>(pl + sizeof(K), 0),
+                      pl + sizeof(K) + sizeof(uint32_t)};
+    }
+
+    // Calls f(key, i) on the keys of all entries in order. f returns false
+    // to stop.
+    template <class F>
+    static inline bool decode_keys_cond(uint8_t* bytes, size_t size, const F& f) {
+      form fm = (form)*form_p(bytes, size);
+      size_t i = 0;
+      if (fm == kRuns) {
+        runs_t rs = get_runs(bytes, size);
+        for (size_t r=0; r<rs.n; r++) {
+          K k = rs.start(r);
+          for (size_t e = rs.end(r); i < e; i++, k++) {
+            if (!f(k, i)) return false;
+          }
+        }
+      } else if (fm == kBitmap) {
+        bitmap_t bm = get_bitmap(bytes, size);
+        for (size_t w=0; w<bm.n_words; w++) {
+          uint64_t word = bm.word(w);
+          while (word) {
+            K k = bm.base + 64*w + __builtin_ctzll(word);
+            if (!f(k, i++)) return false;
+            word &= word - 1;
+          }
+        }
+      } else {
+        uint8_t* pl = payload(bytes, size);
+        K k = load<K>(pl, 0);
+        uint8_t* diffs = pl + sizeof(K);
+        if (!f(k, 0)) return false;
+        for (i=1; i<size; i++) {
+          k += decodeUnsigned<K>(diffs);
+          if (!f(k, i)) return false;
         }
       }
+      return true;
     }
 
     template <class F>
     static inline void decode(uint8_t* bytes, size_t size, const F& f) {
-      V* vals = (V*)bytes;
-      uint8_t* key_bytes = (bytes + size*sizeof(V));
+      auto g = [&] (const K& k, size_t i) {
+        f(values::entry(bytes, k, i));
+        return true;
+      };
+      decode_keys_cond(bytes, size, g);
+    }
 
-      K prev_key = *((K*)key_bytes);
-      f(Entry::to_entry(prev_key, vals[0]));
-      key_bytes += sizeof(K);
-      for (size_t i=1; i<size; i++) {
-        prev_key += decodeUnsigned<K>(key_bytes);
-        f(Entry::to_entry(prev_key, vals[i]));
-      }
+    static constexpr bool has_decode_columns = true;
+    static inline void decode_columns(uint8_t* bytes, size_t size,
+                                      K* keys, typename values::V* vals) {
+      auto g = [&] (const K& k, size_t i) {
+        keys[i] = k;
+        return true;
+      };
+      decode_keys_cond(bytes, size, g);
+      values::copy(bytes, size, vals);
     }
 
     template <class F>
     static inline void inplace_update(uint8_t* bytes, size_t size, const F& f) {
-      V* vals = (V*)bytes;
-      uint8_t* key_bytes = (bytes + size*sizeof(V));
-
-      K prev_key = *((K*)key_bytes);
-      vals[0] = f(Entry::to_entry(prev_key, vals[0]));
-      key_bytes += sizeof(K);
-      for (size_t i=1; i<size; i++) {
-        prev_key += decodeUnsigned<K>(key_bytes);
-        vals[i] = f(Entry::to_entry(prev_key, vals[i]));
-      }
+      auto g = [&] (const K& k, size_t i) {
+        values::update(bytes, k, i, f);
+        return true;
+      };
+      decode_keys_cond(bytes, size, g);
     }
 
     template <class F>
     static inline bool decode_cond(uint8_t* bytes, uint32_t size, const F& f) {
-      V* vals = (V*)bytes;
-      uint8_t* key_bytes = (bytes + size*sizeof(V));
-
-      ET e;
-      std::get<0>(e) = *((K*)key_bytes);
-      std::get<1>(e) = vals[0];
-      if (!f(e)) return false;
-      key_bytes += sizeof(K);
-      for (uint32_t i=1; i<size; i++) {
-        std::get<0>(e) += decodeUnsigned<K>(key_bytes);
-        std::get<1>(e) = vals[i];
-        if (!f(e)) return false;
+      auto g = [&] (const K& k, size_t i) {
+        return f(values::entry(bytes, k, i));
+      };
+      return decode_keys_cond(bytes, size, g);
+    }
+
+    // Number of entries whose key is less than k.
+    template <class F, class Comp, class Key>
+    static inline size_t rank(uint8_t* bytes, size_t size,
+          const F& f, const Comp& comp, const Key& key) {
+      form fm = (form)*form_p(bytes, size);
+      if (fm == kRuns) {
+        runs_t rs = get_runs(bytes, size);
+        size_t lo = 0, hi = rs.n;  // runs [0, lo) start before key
+        while (lo < hi) {
+          size_t mid = (lo + hi) / 2;
+          if (comp(rs.start(mid), key)) lo = mid + 1;
+          else hi = mid;
+        }
+        if (lo == 0) return 0;
+        size_t r = lo - 1;
+        size_t len = rs.end(r) - rs.begin(r);
+        return rs.begin(r) + std::min<size_t>(len, K(key) - rs.start(r));
+      } else if (fm == kBitmap) {
+        bitmap_t bm = get_bitmap(bytes, size);
+        if (!comp(bm.base, key)) return 0;
+        K off = K(key) - bm.base;
+        size_t w = off >> 6;
+        if (w >= bm.n_words) return size;
+        size_t ret = 0;
+        for (size_t j=0; j<w; j++) ret += __builtin_popcountll(bm.word(j));
+        return ret + __builtin_popcountll(bm.word(w) & ((uint64_t(1) << (off & 63)) - 1));
+      } else {
+        size_t ret = 0;
+        auto count = [&] (const K& k, size_t i) -> bool {
+          if (!comp(k, key)) return false;
+          ret = i + 1;
+          return true;
+        };
+        decode_keys_cond(bytes, size, count);
+        return ret;
       }
-      return true;
     }
 
     // F: ET -> K
-    template <class F, class Comp, class K>
+    template <class F, class Comp, class Key>
     static inline std::optional<ET> find(uint8_t* bytes, size_t size,
-          const F& f, const Comp& comp, const K& k) {
-      std::optional<ET> ret;
-      auto test = [&] (const ET& et) -> bool {
-        if (!(comp(k, f(et)) || comp(f(et), k))) {
-          ret = et;
+          const F& f, const Comp& comp, const Key& key) {
+      form fm = (form)*form_p(bytes, size);
+      if (fm == kDelta) {
+        std::optional<ET> ret;
+        auto test = [&] (const K& k, size_t i) -> bool {
+          if (comp(k, key)) return true;
+          if (!comp(key, k)) ret = values::entry(bytes, k, i);
           return false;
+        };
+        decode_keys_cond(bytes, size, test);
+        return ret;
+      }
+      size_t i = rank(bytes, size, f, comp, key);
+      if (i == size) return std::nullopt;
+      if (fm == kBitmap) {
+        bitmap_t bm = get_bitmap(bytes, size);
+        if (comp(key, bm.base)) return std::nullopt;
+        K off = K(key) - bm.base;
+        if ((bm.word(off >> 6) >> (off & 63)) & 1) return values::entry(bytes, K(key), i);
+        return std::nullopt;
+      }
+      // Runs: the key is present iff the i-th key equals it.
+      ET e = select(bytes, size, i);
+      if (comp(key, Entry::get_key(e))) return std::nullopt;
+      return e;
+    }
+
+    // The i-th entry of the block (i < size).
+    static inline ET select(uint8_t* bytes, size_t size, size_t i) {
+      form fm = (form)*form_p(bytes, size);
+      if (fm == kRuns) {
+        runs_t rs = get_runs(bytes, size);
+        size_t lo = 0, hi = rs.n;  // first run ending after i
+        while (lo < hi) {
+          size_t mid = (lo + hi) / 2;
+          if (rs.end(mid) <= i) lo = mid + 1;
+          else hi = mid;
         }
-        return true;
-      };
-      decode_cond(bytes, size, test);
-      return ret;
+        return values::entry(bytes, rs.start(lo) + (i - rs.begin(lo)), i);
+      } else if (fm == kBitmap) {
+        bitmap_t bm = get_bitmap(bytes, size);
+        size_t rem = i, w = 0;
+        for (;; w++) {
+          size_t c = __builtin_popcountll(bm.word(w));
+          if (rem < c) break;
+          rem -= c;
+        }
+        uint64_t word = bm.word(w);
+        for (; rem > 0; rem--) word &= word - 1;
+        return values::entry(bytes, bm.base + 64*w + __builtin_ctzll(word), i);
+      } else {
+        K ret;
+        auto get = [&] (const K& k, size_t j) -> bool {
+          ret = k;
+          return j < i;
+        };
+        decode_keys_cond(bytes, size, get);
+        return values::entry(bytes, ret, i);
+      }
+    }
+
+    // Writes the keys of (a op b) to out in order and returns their number,
+    // or -1 if the two blocks are not both runs or both bitmaps. Only
+    // defined for sets.
+    static inline long set_op(block_set_op op, uint8_t* a, size_t na,
+                              uint8_t* b, size_t nb, K* out) {
+      if constexpr (kHasVals) {
+        return -1;
+      } else {
+        form fa = (form)*form_p(a, na), fb = (form)*form_p(b, nb);
+        if (fa != fb || fa == kDelta) return -1;
+        size_t n = 0;
+        auto emit = [&] (K s, K l) {  // the keys s..l (inclusive)
+          for (K k = s; ; k++) {
+            out[n++] = k;
+            if (k == l) break;
+          }
+        };
+        if (fa == kBitmap) {
+          bitmap_t ba = get_bitmap(a, na), bb = get_bitmap(b, nb);
+          uint64_t wa = ba.base >> 6, wb = bb.base >> 6;
+          uint64_t lo = (op == block_set_op::difference_op) ? wa : std::min(wa, wb);
+          uint64_t hi = (op == block_set_op::difference_op) ? wa + ba.n_words
+                                                     : std::max(wa + ba.n_words, wb + bb.n_words);
+          if (op == block_set_op::intersect_op) {
+            lo = std::max(wa, wb);
+            hi = std::min(wa + ba.n_words, wb + bb.n_words);
+          }
+          for (uint64_t w = lo; w < hi; w++) {
+            uint64_t x = ba.word_at(w), y = bb.word_at(w);
+            uint64_t r = (op == block_set_op::union_op) ? (x | y)
+                       : (op == block_set_op::intersect_op) ? (x & y) : (x & ~y);
+            while (r) {
+              out[n++] = K((w << 6) + __builtin_ctzll(r));
+              r &= r - 1;
+            }
+          }
+          return n;
+        }
+        runs_t ra = get_runs(a, na), rb = get_runs(b, nb);
+        if (op == block_set_op::union_op) {
+          bool have = false;
+          K last = 0;
+          size_t i = 0, j = 0;
+          while (i < ra.n || j < rb.n) {
+            bool from_a = (j == rb.n) || (i < ra.n && ra.start(i) <= rb.start(j));
+            K s = from_a ? ra.start(i) : rb.start(j);
+            K l = from_a ? ra.last(i) : rb.last(j);
+            if (from_a) i++; else j++;
+            if (have && l <= last) continue;
+            if (have && s <= last) s = last + 1;
+            emit(s, l);
+            have = true;
+            last = l;
+          }
+        } else if (op == block_set_op::intersect_op) {
+          size_t i = 0, j = 0;
+          while (i < ra.n && j < rb.n) {
+            K s = std::max(ra.start(i), rb.start(j));
+            K la = ra.last(i), lb = rb.last(j);
+            K l = std::min(la, lb);
+            if (s <= l) emit(s, l);
+            if (la <= lb) i++;
+            if (lb <= la) j++;
+          }
+        } else {
+          size_t j = 0;
+          for (size_t i=0; i<ra.n; i++) {
+            K cur = ra.start(i), l = ra.last(i);
+            while (j < rb.n && rb.last(j) < cur) j++;
+            bool done = false;
+            for (size_t k = j; k < rb.n && rb.start(k) <= l; k++) {
+              if (rb.start(k) > cur) emit(cur, rb.start(k) - 1);
+              if (rb.last(k) >= l) { done = true; break; }
+              cur = std::max(cur, K(rb.last(k) + 1));
+            }
+            if (!done) emit(cur, l);
+          }
+        }
+        return n;
+      }
     }
 
     static inline void destroy(uint8_t* bytes, size_t size) {
+      values::destroy(bytes, size);
+    }
+  };
+};
+
+// Value codecs for composite_entry_encoder. codec<V> provides
+//   encoded_size(get, n), encode(get, n, bytes): get(i) returns the i-th value,
+//   reader(bytes).next(): the values in order,
+//   get(bytes, n, i): the i-th value,
+//   destroy(bytes, n),
+// and, if kInplace, values(bytes): the stored V array, for in-place updates.
+
+// Values stored as a plain array.
+struct raw_value_codec {
+  template <class V>
+  struct codec {
+    static constexpr bool kInplace = true;
+
+    template <class G>
+    static inline size_t encoded_size(const G& get, size_t n) {
+      return n*sizeof(V);
+    }
+
+    template <class G>
+    static inline void encode(const G& get, size_t n, uint8_t* bytes) {
       V* vals = (V*)bytes;
-      for (size_t i=0; i<size; i++) {
+      for (size_t i=0; i<n; i++) {
+        parlay::assign_uninitialized(vals[i], get(i));
+      }
+    }
+
+    struct reader {
+      V* p;
+      reader(uint8_t* bytes) : p((V*)bytes) {}
+      V next() { return *p++; }
+    };
+
+    static inline V get(uint8_t* bytes, size_t n, size_t i) { return ((V*)bytes)[i]; }
+
+    static inline V* values(uint8_t* bytes) { return (V*)bytes; }
+
+    static inline void destroy(uint8_t* bytes, size_t n) {
+      V* vals = (V*)bytes;
+      for (size_t i=0; i<n; i++) {
         vals[i].~V();
       }
     }
   };
 };
 
+// Integer values as varints; with kZigZag, signed values are zigzag mapped
+// first so that small negative values also take few bytes.
+template <bool kZigZag>
+struct varint_value_codec_t {
+  template <class V>
+  struct codec {
+    static_assert(std::is_integral_v<V>, "varint value codecs require integer values");
+    using U = std::make_unsigned_t<V>;
+    static constexpr bool kInplace = false;
+
+    static inline U to_unsigned(V v) {
+      if constexpr (kZigZag && std::is_signed_v<V>) {
+        return (U(v) << 1) ^ U(v >> (8*sizeof(V) - 1));
+      } else {
+        return U(v);
+      }
+    }
+
+    static inline V from_unsigned(U u) {
+      if constexpr (kZigZag && std::is_signed_v<V>) {
+        return V((u >> 1) ^ (~(u & 1) + 1));
+      } else {
+        return V(u);
+      }
+    }
+
+    template <class G>
+    static inline size_t encoded_size(const G& get, size_t n) {
+      size_t ret = 0;
+      for (size_t i=0; i<n; i++) {
+        ret += varintBytes<U>(to_unsigned(get(i)));
+      }
+      return ret;
+    }
+
+    template <class G>
+    static inline void encode(const G& get, size_t n, uint8_t* bytes) {
+      long offset = 0;
+      for (size_t i=0; i<n; i++) {
+        offset = encodeVarint<U>(bytes, offset, to_unsigned(get(i)));
+      }
+    }
+
+    struct reader {
+      uint8_t* p;
+      reader(uint8_t* bytes) : p(bytes) {}
+      V next() { return from_unsigned(decodeUnsigned<U>(p)); }
+    };
+
+    static inline V get(uint8_t* bytes, size_t n, size_t i) {
+      for (; i > 0; bytes++) {
+        i -= !LAST_BIT_SET(*bytes);
+      }
+      return from_unsigned(decodeUnsigned<U>(bytes));
+    }
+
+    static inline void destroy(uint8_t* bytes, size_t n) {}
+  };
+};
+
+using varint_value_codec = varint_value_codec_t<false>;
+using zigzag_value_codec = varint_value_codec_t<true>;
+
+// Values replaced by indices into a per-block table of the distinct values,
+// for columns with few distinct values. Indices take 1, 2 or 4 bytes
+// depending on the size of the table. V must be trivially copyable and
+// ordered by <.
+struct dictionary_value_codec {
+  template <class V>
+  struct codec {
+    static_assert(std::is_trivially_copyable_v<V>,
+                  "dictionary_value_codec requires trivially copyable values");
+    static constexpr bool kInplace = false;
+
+    // Layout: uint32_t n_dict | V dict[n_dict] | index[n]
+
+    template <class G>
+    static inline std::vector<V> dictionary(const G& get, size_t n) {
+      std::vector<V> dict(n);
+      for (size_t i=0; i<n; i++) dict[i] = get(i);
+      std::sort(dict.begin(), dict.end());
+      dict.erase(std::unique(dict.begin(), dict.end()), dict.end());
+      return dict;
+    }
+
+    static inline size_t index_bytes(size_t n_dict) {
+      return (n_dict <= (1 << 8)) ? 1 : (n_dict <= (1 << 16)) ? 2 : 4;
+    }
+
+    template <class G>
+    static inline size_t encoded_size(const G& get, size_t n) {
+      size_t n_dict = dictionary(get, n).size();
+      return sizeof(uint32_t) + n_dict*sizeof(V) + n*index_bytes(n_dict);
+    }
+
+    template <class G>
+    static inline void encode(const G& get, size_t n, uint8_t* bytes) {
+      auto dict = dictionary(get, n);
+      uint32_t n_dict = dict.size();
+      std::memcpy(bytes, &n_dict, sizeof(uint32_t));
+      std::memcpy(bytes + sizeof(uint32_t), dict.data(), n_dict*sizeof(V));
+      uint8_t* idx = bytes + sizeof(uint32_t) + n_dict*sizeof(V);
+      size_t w = index_bytes(n_dict);
+      for (size_t i=0; i<n; i++) {
+        uint32_t j = std::lower_bound(dict.begin(), dict.end(), get(i)) - dict.begin();
+        std::memcpy(idx + i*w, &j, w);  // little-endian
+      }
+    }
+
+    static inline uint32_t num_dict(uint8_t* bytes) {
+      uint32_t n_dict;
+      std::memcpy(&n_dict, bytes, sizeof(uint32_t));
+      return n_dict;
+    }
+
+    static inline V lookup(uint8_t* bytes, uint32_t j) {
+      V v;
+      std::memcpy(&v, bytes + sizeof(uint32_t) + j*sizeof(V), sizeof(V));
+      return v;
+    }
+
+    struct reader {
+      uint8_t* bytes;
+      uint8_t* idx;
+      size_t w;
+      reader(uint8_t* b) : bytes(b) {
+        uint32_t n_dict = num_dict(b);
+        idx = b + sizeof(uint32_t) + n_dict*sizeof(V);
+        w = index_bytes(n_dict);
+      }
+      V next() {
+        uint32_t j = 0;
+        std::memcpy(&j, idx, w);
+        idx += w;
+        return lookup(bytes, j);
+      }
+    };
+
+    static inline V get(uint8_t* bytes, size_t n, size_t i) {
+      reader r(bytes);
+      r.idx += i*r.w;
+      return r.next();
+    }
+
+    static inline void destroy(uint8_t* bytes, size_t n) {}
+  };
+};
+
+// Composes an encoder for the keys (any of the key encoders above, applied to
+// the keys alone) with a value codec, so that maps can compress both
+// columns, e.g. composite_entry_encoder<diffencoded_entry_encoder,
+// varint_value_codec>.
+template <class KeyEncoder, class ValueCodec = raw_value_codec>
+struct composite_entry_encoder {
+
+  struct data {};
+
+  // Presents the keys of Entry as the entries of a set.
+  template <class Entry>
+  struct key_entry {
+    using key_t = typename Entry::key_t;
+    using val_t = bool;  // not used
+    using entry_t = key_t;
+    static inline key_t get_key(const entry_t& e) { return e; }
+    static inline val_t get_val(const entry_t& e) { return 0; }
+    static inline entry_t to_entry(const key_t& k, const val_t& v) { return k; }
+  };
+
+  template <class Entry, bool is_aug = false>
+  struct encoder {
+    using ET = typename Entry::entry_t;
+    using K = typename Entry::key_t;
+    using V = typename Entry::val_t;
+    using keys = typename KeyEncoder::template encoder<key_entry<Entry>>;
+    using codec = typename ValueCodec::template codec<V>;
+    static constexpr bool is_trivial = false;
+
+    // Block layout: uint32_t value_bytes | value block | key block
+
+    // Keys are copied out of the entries before being encoded; blocks up to
+    // kStackKeys entries use a buffer on the stack.
+    static constexpr size_t kStackKeys = 1024;
+
+    template <class F>
+    static inline auto with_keys(ET* data, size_t size, const F& f) {
+      auto fill = [&] (K* ks) {
+        for (size_t i=0; i<size; i++) ks[i] = Entry::get_key(data[i]);
+        return f(ks);
+      };
+      if (size <= kStackKeys) {
+        K ks[kStackKeys];
+        return fill(ks);
+      }
+      std::vector<K> ks(size);
+      return fill(ks.data());
+    }
+
+    static inline size_t value_bytes(uint8_t* bytes) {
+      uint32_t vb;
+      std::memcpy(&vb, bytes, sizeof(uint32_t));
+      return vb;
+    }
+
+    static inline uint8_t* value_block(uint8_t* bytes) {
+      return bytes + sizeof(uint32_t);
+    }
+
+    static inline uint8_t* key_block(uint8_t* bytes) {
+      return bytes + sizeof(uint32_t) + value_bytes(bytes);
+    }
+
+    static inline K key_of(const K& k) { return k; }
+
+    static inline void print_info(const ET& et) {
+    }
+
+    static inline size_t encoded_size(ET* data, size_t size) {
+      auto get = [&] (size_t i) { return Entry::get_val(data[i]); };
+      size_t kb = with_keys(data, size, [&] (K* ks) {
+        return keys::encoded_size(ks, size);
+      });
+      return sizeof(uint32_t) + codec::encoded_size(get, size) + kb;
+    }
+
+    static inline auto encode(ET* data, size_t size, uint8_t* bytes) {
+      auto get = [&] (size_t i) { return Entry::get_val(data[i]); };
+      uint32_t vb = codec::encoded_size(get, size);
+      std::memcpy(bytes, &vb, sizeof(uint32_t));
+      codec::encode(get, size, value_block(bytes));
+      with_keys(data, size, [&] (K* ks) {
+        keys::encode(ks, size, key_block(bytes));
+        return 0;
+      });
+      if constexpr (is_aug) {
+        using AT = typename Entry::aug_t;
+        AT av = Entry::from_entry(data[0]);
+        for (size_t i=1; i<size; i++) {
+          av = Entry::combine(std::move(av), Entry::from_entry(data[i]));
+        }
+        return av;
+      }
+    }
+
+    template <class F>
+    static inline void decode(uint8_t* bytes, size_t size, const F& f) {
+      typename codec::reader r(value_block(bytes));
+      keys::decode(key_block(bytes), size, [&] (const K& k) {
+        f(Entry::to_entry(k, r.next()));
+      });
+    }
+
+    static constexpr bool has_decode_columns = true;
+    static inline void decode_columns(uint8_t* bytes, size_t size, K* ks, V* vals) {
+      keys::decode_columns(key_block(bytes), size, ks, (bool*)nullptr);
+      if (vals) {
+        typename codec::reader r(value_block(bytes));
+        for (size_t i=0; i<size; i++) {
+          vals[i] = r.next();
+        }
+      }
+    }
+
+    template <class F>
+    static inline void inplace_update(uint8_t* bytes, size_t size, const F& f) {
+      // Re-encoding the values can change the size of the block, so only
+      // codecs that store a plain array support in-place updates.
+      static_assert(codec::kInplace,
+                    "in-place updates require a value codec with kInplace");
+      V* vals = codec::values(value_block(bytes));
+      size_t i = 0;
+      keys::decode(key_block(bytes), size, [&] (const K& k) {
+        vals[i] = f(Entry::to_entry(k, vals[i]));
+        i++;
+      });
+    }
+
+    template <class F>
+    static inline bool decode_cond(uint8_t* bytes, uint32_t size, const F& f) {
+      typename codec::reader r(value_block(bytes));
+      return keys::decode_cond(key_block(bytes), size, [&] (const K& k) {
+        return f(Entry::to_entry(k, r.next()));
+      });
+    }
+
+    // F: ET -> K
+    template <class F, class Comp, class Key>
+    static inline std::optional<ET> find(uint8_t* bytes, size_t size,
+          const F& f, const Comp& comp, const Key& k) {
+      uint8_t* kb = key_block(bytes);
+      size_t i = keys::rank(kb, size, key_of, comp, k);
+      if (i < size) {
+        K key = keys::select(kb, size, i);
+        if (!comp(k, key)) {
+          return Entry::to_entry(key, codec::get(value_block(bytes), size, i));
+        }
+      }
+      return std::nullopt;
+    }
+
+    // Number of entries whose key is less than k.
+    template <class F, class Comp, class Key>
+    static inline size_t rank(uint8_t* bytes, size_t size,
+          const F& f, const Comp& comp, const Key& k) {
+      return keys::rank(key_block(bytes), size, key_of, comp, k);
+    }
+
+    static inline ET select(uint8_t* bytes, size_t size, size_t i) {
+      return Entry::to_entry(keys::select(key_block(bytes), size, i),
+                             codec::get(value_block(bytes), size, i));
+    }
+
+    static inline void destroy(uint8_t* bytes, size_t size) {
+      codec::destroy(value_block(bytes), size);
+    }
+  };
+};
+
 struct null_encoder {
   template <class ET>
   static inline void print_info(const ET& et) {
@@ -175,6 +1681,15 @@ struct null_encoder {
         const F& f, const Comp& comp, const K& k) {
     assert(false);
     exit(-1);}
+  template <class F, class Comp, class K>
+  static inline size_t rank(uint8_t* bytes, size_t size,
+        const F& f, const Comp& comp, const K& k) {
+    assert(false);
+    exit(-1);}
+  template <class ET>
+  static inline ET select(uint8_t* bytes, size_t size, size_t i) {
+    assert(false);
+    exit(-1);}
   static inline void destroy(uint8_t* bytes, size_t size) {
     assert(false);
     exit(-1);}
@@ -236,6 +1751,24 @@ struct default_entry_encoder {
       }
     }
 
+    static inline ET* entries(uint8_t* bytes) {
+      return (ET*)bytes;
+    }
+
+    static constexpr bool has_decode_columns = true;
+    template <class K, class V>
+    static inline void decode_columns(uint8_t* bytes, size_t size, K* keys, V* vals) {
+      ET* ets = (ET*)bytes;
+      for (size_t i=0; i<size; i++) {
+        keys[i] = Entry::get_key(ets[i]);
+      }
+      if (vals) {
+        for (size_t i=0; i<size; i++) {
+          vals[i] = Entry::get_val(ets[i]);
+        }
+      }
+    }
+
     template <class F>
     static inline void inplace_update(uint8_t* bytes, size_t size, const F& f) {
       std::cout << "Unimplemented" << std::endl;
@@ -265,6 +1798,21 @@ struct default_entry_encoder {
       return std::nullopt;
     }
 
+    // Number of entries whose key is less than k. Entries are stored
+    // uncompressed, so a binary search over the block suffices.
+    template <class F, class Comp, class K>
+    static inline size_t rank(uint8_t* bytes, size_t size,
+          const F& f, const Comp& comp, const K& k) {
+      ET* ets = (ET*)bytes;
+      auto seq = parlay::delayed_seq<K>(size, [&] (size_t i) { return f(ets[i]); });
+      return parlay::internal::binary_search(seq, k, comp);
+    }
+
+    static inline ET select(uint8_t* bytes, size_t size, size_t i) {
+      ET* ets = (ET*)bytes;
+      return ets[i];
+    }
+
     static inline void destroy(uint8_t* bytes, size_t size) {
       ET* ets = (ET*)bytes;
       for (size_t i=0; i<size; i++) {
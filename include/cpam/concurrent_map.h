@@ -0,0 +1,158 @@
+#pragma once
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "parlay/primitives.h"
+#include "versioned_map.h"
+
+namespace cpam {
+
+// *******************************************
+//   CONCURRENT MAPS
+// *******************************************
+
+// Wraps a map (pam_map, aug_map, pam_set, ...) for point updates from many
+// parlay workers, using flat combining. An update is appended to a shared
+// queue; if no thread is combining, the caller becomes the combiner: it
+// drains the whole queue, sorts it, applies it with one multi_delete_sorted
+// and one multi_insert_sorted, publishes the new root, and repeats until the
+// queue is empty. Other updaters return right away, and their updates go
+// into a later batch of the running combiner. An update is visible to
+// snapshot() once flush() returns (or once the call returns, for the
+// combiner).
+//
+// Callers must be parlay workers, i.e. the calls are made from inside
+// parlay::parallel_for or par_do, or from the main thread outside of them.
+// The combiner allocates nodes through its worker's free lists, and threads
+// that the scheduler did not start share those of worker 0. Updaters never
+// wait for the combiner, since a combiner waiting inside the scheduler can
+// steal and run another update; flush() does wait, so it must be called
+// outside of parallel regions.
+//
+// Within a batch the last queued update to a key wins; inserts replace the
+// value of an existing key.
+// Readers take a snapshot, a reference-counted version that later batches
+// do not change. Each batch is committed to a versioned_map, so readers
+// acquire the latest root without locking.
+template <class Map>
+struct concurrent_map {
+  using M = Map;
+  using Entry = typename M::Entry;
+  using E = typename M::E;
+  using K = typename M::K;
+
+  concurrent_map() {}
+  explicit concurrent_map(M m) : versions(std::move(m)) {}
+  ~concurrent_map() { flush(); }
+
+  concurrent_map(const concurrent_map&) = delete;
+  concurrent_map& operator = (const concurrent_map&) = delete;
+
+  void insert(const E& e) { update({Entry::get_key(e), e}); }
+  void remove(const K& k) { update({k, std::nullopt}); }
+
+  // Applies the queued updates, if any. Must not be called from inside a
+  // parallel region.
+  void flush() {
+    std::unique_lock<std::mutex> l(combine_lock);
+    batch_done.wait(l, [&] { return !combining; });
+    combine(l);
+  }
+
+  // The current version.
+  M snapshot() const { return versions.acquire_latest().map(); }
+
+  size_t size() const { return snapshot().size(); }
+  auto find(const K& k) const {
+    return snapshot().find(k);
+  }
+  bool contains(const K& k) const { return snapshot().contains(k); }
+
+  // Number of batches applied so far.
+  size_t num_batches() {
+    std::lock_guard<std::mutex> g(combine_lock);
+    return applied;
+  }
+
+private:
+  struct update_t {
+    K key;
+    std::optional<E> entry;  // empty for a remove
+  };
+
+  mutable versioned_map<M> versions;  // the batches applied so far
+  std::mutex queue_lock;            // guards pending
+  std::vector<update_t> pending;
+  std::mutex combine_lock;          // guards combining and applied
+  bool combining = false;
+  size_t applied = 0;               // batches published
+  std::condition_variable batch_done;
+
+  void update(update_t u) {
+    {
+      std::lock_guard<std::mutex> g(queue_lock);
+      pending.push_back(std::move(u));
+    }
+    std::unique_lock<std::mutex> l(combine_lock);
+    if (!combining) combine(l);
+  }
+
+  // Becomes the combiner (l holds combine_lock and no one else is
+  // combining) and applies batches with l released until the queue is
+  // empty. The queue is checked with combine_lock held, so an updater that
+  // finds combining set has its update drained by a later batch.
+  void combine(std::unique_lock<std::mutex>& l) {
+    combining = true;
+    while (true) {
+      l.unlock();
+      bool nonempty = apply_batch();
+      l.lock();
+      applied += nonempty;
+      std::lock_guard<std::mutex> g(queue_lock);
+      if (pending.empty()) break;
+    }
+    combining = false;
+    batch_done.notify_all();
+  }
+
+  // Drains the queue and publishes a version with its updates applied;
+  // returns whether there were any.
+  bool apply_batch() {
+    std::vector<update_t> batch;
+    {
+      std::lock_guard<std::mutex> g(queue_lock);
+      batch.swap(pending);
+    }
+    if (!batch.empty()) {
+      auto less = [] (const update_t& a, const update_t& b) {
+        return Entry::comp(a.key, b.key); };
+      auto sorted = parlay::stable_sort(batch, less);
+      size_t n = sorted.size();
+      // the last update to each key
+      auto last = parlay::filter(parlay::iota(n), [&] (size_t i) {
+        return i + 1 == n || less(sorted[i], sorted[i+1]); });
+      auto ins = parlay::map(parlay::filter(last, [&] (size_t i) {
+        return sorted[i].entry.has_value(); }),
+        [&] (size_t i) { return *sorted[i].entry; });
+      auto del = parlay::map(parlay::filter(last, [&] (size_t i) {
+        return !sorted[i].entry.has_value(); }),
+        [&] (size_t i) { return sorted[i].key; });
+
+      M m = snapshot();
+      if (del.size() > 0) {
+        m = M::multi_delete_sorted(std::move(m), parlay::make_slice(del));
+      }
+      if (ins.size() > 0) {
+        auto replace = [] (const auto& a, const auto& b) { return b; };
+        m = M::multi_insert_sorted(std::move(m), parlay::make_slice(ins), replace);
+      }
+      // the replaced version is reclaimed once its readers release it
+      versions.commit(std::move(m));
+    }
+    return !batch.empty();
+  }
+};
+
+}  // namespace cpam
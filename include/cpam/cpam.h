@@ -6,10 +6,18 @@
 #include "utils.h"
 #include "gc.h"
 #include "weight_balanced_tree.h"
+#include "avl_tree.h"
+#include "red_black_tree.h"
+#include "treap.h"
 #include "sequence_ops.h"
 #include "map_ops.h"
 #include "augmented_ops.h"
 #include "build.h"
+#include "snapshot.h"
+#include "cursor.h"
 #include "map.h"
 #include "augmented_map.h"
+#include "adaptive_map.h"
+#include "versioned_map.h"
+#include "concurrent_map.h"
 
@@ -0,0 +1,194 @@
+#pragma once
+#include <type_traits>
+#include <vector>
+
+#include "utils.h"
+
+namespace cpam {
+
+// *******************************************
+//   CURSORS
+// *******************************************
+
+// A pull-based position in a tree, for merging several maps or pausing and
+// resuming a scan. The cursor holds a reference to the root, so it reads the
+// version of the tree it was created from, whatever happens to the map
+// afterwards.
+//
+// The current entry is either the entry of a regular node or an entry of a
+// compressed node; the latter is decoded in full when the cursor enters it,
+// so consecutive steps within a block cost no decoding. path holds the
+// regular ancestors of the current node and the side the current node lies
+// on, which is all next() and prev() need to move between blocks.
+template <class Tree>
+struct tree_cursor {
+  using node = typename Tree::node;
+  using regular_node = typename Tree::regular_node;
+  using Entry = typename Tree::Entry;
+  using ET = typename Tree::ET;
+  using K = typename Entry::key_t;
+  using GC = typename Tree::GC;
+  static constexpr size_t kWindowSize = 2*Tree::B;
+
+  // Takes a new reference to root. The cursor starts out invalid.
+  explicit tree_cursor(node* root) : root(root), cur(nullptr),
+      window(utils::new_array_no_init<ET>(kWindowSize)), window_size(0), i(0) {
+    GC::increment(root);
+  }
+
+  tree_cursor(const tree_cursor& c) : root(c.root), path(c.path), cur(c.cur),
+      window(utils::new_array_no_init<ET>(kWindowSize)), window_size(0), i(c.i) {
+    GC::increment(root);
+    if (cur && Tree::is_compressed(cur)) load_block(cur);
+  }
+
+  tree_cursor(tree_cursor&& c) : root(c.root), path(std::move(c.path)),
+      cur(c.cur), window(c.window), window_size(c.window_size), i(c.i) {
+    c.root = nullptr; c.cur = nullptr; c.window = nullptr; c.window_size = 0;
+  }
+
+  tree_cursor& operator = (tree_cursor c) {
+    std::swap(root, c.root); std::swap(path, c.path); std::swap(cur, c.cur);
+    std::swap(window, c.window); std::swap(window_size, c.window_size);
+    std::swap(i, c.i);
+    return *this;
+  }
+
+  ~tree_cursor() {
+    if (!window) return;
+    clear_window();
+    utils::free_array(window, kWindowSize);
+    if (root && GC::initialized()) GC::retire(root);
+  }
+
+  bool valid() const { return cur != nullptr; }
+
+  // The current entry; the cursor must be valid.
+  const ET& entry() const {
+    return Tree::is_regular(cur) ? Tree::get_entry(cur) : window[i];
+  }
+  K key() const { return Entry::get_key(entry()); }
+
+  // Moves to the first entry whose key is not less than k.
+  bool seek(const K& k) {
+    path.clear();
+    clear_window();
+    node* a = root;
+    while (a && Tree::is_regular(a)) {
+      regular_node* r = Tree::cast_to_regular(a);
+      bool right = Entry::comp(Entry::get_key(Tree::get_entry(a)), k);
+      path.push_back({r, right});
+      a = right ? r->rc : r->lc;
+    }
+    if (a) {
+      load_block(a);
+      i = 0;
+      while (i < window_size && Entry::comp(Entry::get_key(window[i]), k)) i++;
+      if (i < window_size) { cur = a; return true; }
+      clear_window();
+    }
+    return climb(false);
+  }
+
+  bool seek_first() {
+    path.clear();
+    clear_window();
+    if (!root) { cur = nullptr; return false; }
+    descend(root, false);
+    return true;
+  }
+
+  bool seek_last() {
+    path.clear();
+    clear_window();
+    if (!root) { cur = nullptr; return false; }
+    descend(root, true);
+    return true;
+  }
+
+  // Moves to the next entry; returns false (and invalidates the cursor)
+  // after the last one.
+  bool next() { return step(true); }
+
+  // Moves to the previous entry; returns false (and invalidates the cursor)
+  // before the first one.
+  bool prev() { return step(false); }
+
+private:
+  struct path_step {
+    regular_node* r;
+    bool right;  // whether the current node lies in r's right subtree
+  };
+
+  node* root;
+  std::vector<path_step> path;
+  node* cur;         // regular node holding the current entry, or the block
+  ET* window;        // decoded entries of cur if it is compressed
+  size_t window_size;
+  size_t i;          // index of the current entry in the window
+
+  void clear_window() {
+    if constexpr (!std::is_trivially_destructible_v<ET>) {
+      for (size_t j = 0; j < window_size; j++) window[j].~ET();
+    }
+    window_size = 0;
+  }
+
+  void load_block(node* a) {
+    clear_window();
+    Tree::compressed_node_elms(a, window);
+    window_size = Tree::size(a);
+  }
+
+  // Moves to the first (or, if last, the last) entry of the subtree at a.
+  void descend(node* a, bool last) {
+    while (Tree::is_regular(a)) {
+      regular_node* r = Tree::cast_to_regular(a);
+      node* c = last ? r->rc : r->lc;
+      if (!c) break;
+      path.push_back({r, last});
+      a = c;
+    }
+    cur = a;
+    if (Tree::is_compressed(a)) {
+      load_block(a);
+      i = last ? window_size - 1 : 0;
+    }
+  }
+
+  // Moves to the nearest ancestor that follows (or, if backward, precedes)
+  // the current subtree.
+  bool climb(bool backward) {
+    while (!path.empty()) {
+      path_step s = path.back();
+      path.pop_back();
+      if (s.right == backward) {
+        clear_window();
+        cur = s.r;
+        return true;
+      }
+    }
+    clear_window();
+    cur = nullptr;
+    return false;
+  }
+
+  bool step(bool forward) {
+    if (!cur) return false;
+    if (Tree::is_compressed(cur)) {
+      if (forward && i + 1 < window_size) { i++; return true; }
+      if (!forward && i > 0) { i--; return true; }
+    } else {
+      regular_node* r = Tree::cast_to_regular(cur);
+      node* c = forward ? r->rc : r->lc;
+      if (c) {
+        path.push_back({r, forward});
+        descend(c, !forward);
+        return true;
+      }
+    }
+    return climb(!forward);
+  }
+};
+
+}  // namespace cpam
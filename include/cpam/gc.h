@@ -1,4 +1,8 @@
 #pragma once
+#include <atomic>
+#include <mutex>
+#include <vector>
+
 #include "basic_node.h"
 #include "utils.h"
 
@@ -22,11 +26,9 @@ struct gc {
   static bool initialized() { return alloc::initialized;}
   static void reserve(size_t n, bool randomize = false) {
     alloc::reserve(n/B);
-    //complex_alloc::reserve(n/B);
     std::cout << "Reserving.... " << (n/B) << " nodes with size = " << sizeof(regular_node) << std::endl;
-    //std::cout << "Reserving.... " << (n/B) << " complex nodes with size = " << sizeof(typename Node::complex_bytes) << std::endl;
   }
-  static void finish() { alloc::finish();}
+  static void finish() { alloc::finish(); complex_alloc::finish();}
   static size_t num_used_nodes() {return alloc::num_used_blocks();}
 
   static void decrement(node* t) {
@@ -60,6 +62,7 @@ struct gc {
   static inline node* copy(node* t) {
     if (Node::is_regular(t)) {
       auto o = Node::make_regular_node(Node::get_entry(t));
+      Node::copy_balance_data(o, t);
       o->lc = inc(Node::cast_to_regular(t)->lc);
       o->rc = inc(Node::cast_to_regular(t)->rc);
       return o;
@@ -76,6 +79,7 @@ struct gc {
     if (!t) std::cout << "copy if needed fail" << std::endl;
     node* res = t;
     if (Node::ref_cnt(t) > 1) {
+      Node::stats::add(Node::stats::kPathCopies);
       res = copy(t);
       decrement_recursive(t);
     }
@@ -118,8 +122,77 @@ struct gc {
 		<< ", node size: " << size
 		<< ", bytes: " << size*allocated << std::endl;
     }
+    complex_alloc::print_stats();
+  }
+
+  /* ========================= Deferred reclamation ========================= */
+
+  // By default, releasing the last reference to a tree frees it right away,
+  // in the releasing thread. In deferred mode, retire() only queues trees of
+  // at least kDeferredMinSize entries, and the next collect() frees all
+  // queued trees in parallel. Since nodes are reference counted, delaying a
+  // release is always safe: queued trees just stay allocated until collected.
+  //
+  // collect() must run on a parlay worker (the allocators keep per-worker
+  // free lists), so it is called by the application, e.g. between batches
+  // of updates, rather than by a background thread.
+  static constexpr size_t kDeferredMinSize = Node::kNodeLimit;
+
+  struct retired_list {
+    std::mutex m;
+    std::vector<node*> roots;
+    std::atomic<bool> deferred{false};
+    std::atomic<size_t> epoch{0};  // number of completed collections
+  };
+  static inline retired_list retired;
+
+  static bool deferred() { return retired.deferred.load(std::memory_order_relaxed); }
+
+  // Turning deferred mode off collects the queued trees.
+  static void set_deferred(bool on) {
+    retired.deferred = on;
+    if (!on) collect();
+  }
+
+  // Releases a reference to the tree t, deferring the release in deferred mode.
+  static void retire(node* t) {
+    if (!t) return;
+    if (deferred() && Node::size(t) >= kDeferredMinSize) {
+      std::lock_guard<std::mutex> lock(retired.m);
+      retired.roots.push_back(t);
+    } else {
+      decrement_recursive(t);
+    }
   }
 
+  // Releases all queued trees, including trees retired while collecting
+  // (e.g. maps nested in the entries of a freed tree), and returns their
+  // number.
+  static size_t collect() {
+    size_t total = 0;
+    while (true) {
+      std::vector<node*> roots;
+      {
+        std::lock_guard<std::mutex> lock(retired.m);
+        roots.swap(retired.roots);
+      }
+      if (roots.empty()) break;
+      parlay::parallel_for(0, roots.size(), [&] (size_t i) {
+        decrement_recursive(roots[i]);
+      }, 1);
+      total += roots.size();
+    }
+    retired.epoch++;
+    return total;
+  }
+
+  static size_t num_retired() {
+    std::lock_guard<std::mutex> lock(retired.m);
+    return retired.roots.size();
+  }
+
+  static size_t epoch() { return retired.epoch.load(); }
+
   // TODO:used?
   struct read_ptr {
     read_ptr(node* p) : p(p) {}
@@ -110,13 +110,13 @@ public:
     M empty = M();
     root = Tree::finalize(multi_insert_combine(empty, L, f).get_root()); }
 
-  // clears contents, decrementing ref counts
+  // clears contents, decrementing ref counts (deferred if GC::deferred())
   // has a read/destruct race if concurrent with a reader
   void clear() {
     node* t = root;
     if (__sync_bool_compare_and_swap(&(this->root), t, NULL)) {
       if (GC::initialized()) {
-        GC::decrement_recursive(t);
+        GC::retire(t);
       }
     }
   }
@@ -142,6 +142,10 @@ public:
   template <class F>
   static void foreach_index(const M& m, const F& f, size_t start=0,
 			    size_t granularity = kNodeLimit) {
+    if (Tree::use_numa(m.root)) {
+      Tree::foreach_index_numa(m.root, start, f, granularity);
+      return;
+    }
     Tree::foreach_index(ptr(m.root, true), start, f, granularity);
   }
 
@@ -263,12 +267,37 @@ public:
   // filters elements that satisfy the predicate when applied to the elements.
   template<class F>
   static M filter(M m, const F& f, size_t granularity=kNodeLimit) {
+    if (Tree::use_numa(m.root)) {
+      // m releases the input tree
+      return M(Tree::finalize(Tree::filter_numa(m.root, f, granularity)));
+    }
     return M(Tree::finalize(Tree::filter(m.get_root(), f, granularity))); }
 
   template<class Seq>
   //static M from_sorted(Seq const &S) {
   static M from_sorted(Seq &S) {
-    return M(Tree::from_array(S.data(), S.size()));
+    M x(Tree::from_array(S.data(), S.size()));
+    Tree::numa_place(x.root);
+    return x;
+  }
+
+  // a cursor over the current version of the map (see cursor.h)
+  using cursor = tree_cursor<Tree>;
+  cursor get_cursor() const { return cursor(root); }
+
+  // writes the map to a snapshot file that open() can map back in
+  void save(const std::string& path) const {
+    static_assert(snapshot_storable<E>,
+                  "snapshots store entries verbatim");
+    snapshot_ops<Seq_Tree>::save(root, path);
+  }
+
+  // maps a snapshot written by save() on the same map type; the compressed
+  // nodes stay in the file mapping and are copied on update
+  static M open(const std::string& path) {
+    static_assert(snapshot_storable<E>,
+                  "snapshots store entries verbatim");
+    return M(snapshot_ops<Seq_Tree>::open(path));
   }
 
 
@@ -321,6 +350,8 @@ public:
 //    t.next("union time");
     auto x = M(Tree::multi_insert_sorted(m.get_root(), A.data(), A.size(), replace));
     t.next("MI time");
+    // a large batch rebuilds most of the tree: place it by node (CPAM_NUMA)
+    if (A.size() >= numa_utils::kMinSize) Tree::numa_place(x.root);
     return x;
   }
 
@@ -571,6 +602,31 @@ public:
     //return M(Tree::range(ptr(a.root, true), kl, kr));
   }
 
+  // applies f, in key order, to the entries with keys in [kl, kr] without
+  // building a tree for the range
+  template<class F>
+  static void range_foreach(const M& m, const K& kl, const K& kr, const F& f) {
+    Tree::range_foreach(m.root, kl, kr, f);
+  }
+
+  // Calls on_insert(e), on_delete(e) and on_update(old_e, new_e), in key
+  // order, for the entries added, removed and changed from old_m to new_m.
+  // Subtrees the two share are skipped, so diffing two versions takes time
+  // proportional to their differences. Values are compared with ==.
+  template <class FI, class FD, class FU>
+  static void diff(const M& old_m, const M& new_m, const FI& on_insert,
+                   const FD& on_delete, const FU& on_update) {
+    Tree::diff(old_m.root, new_m.root, on_insert, on_delete, on_update);
+  }
+
+  template<class R, class F>
+  static typename R::T range_map_reduce(const M& m, const K& kl, const K& kr,
+                                        const F& f, const R& r,
+                                        size_t grain=kNodeLimit) {
+    GC::init();
+    return Tree::template range_map_reduce<R>(m.root, kl, kr, f, r, grain);
+  }
+
 //  static M range_number(M& a, K kl, size_t r) {
 //    return M(Tree::range_num(a.root, kl, r));
 //  }
@@ -608,6 +664,10 @@ public:
   static void map_index(M& m, const F& f,
 			size_t granularity=kNodeLimit,
 			size_t start=0) {
+    if (Tree::use_numa(m.root)) {
+      Tree::foreach_index_numa(m.root, start, f, granularity);
+      return;
+    }
     Tree::foreach_index(ptr(m.root, true), start, f, granularity);
   }
 
@@ -620,9 +680,21 @@ public:
   static typename R::T map_reduce(const M& m, const F& f, const R& r,
 				   size_t grain=kNodeLimit) {
     GC::init();
+    if (Tree::use_numa(m.root)) {
+      return Tree::template map_reduce_numa<R>(m.root, f, r, grain);
+    }
     return Tree::template map_reduce<R>(m.root, f, r, grain);
   }
 
+  // f(keys, vals, n) -> R::T reduces the n entries of a block, given as
+  // separate arrays of keys and values (vals is null for sets).
+  template<class R, class F>
+  static typename R::T map_reduce_columns(const M& m, const F& f, const R& r,
+				   size_t grain=kNodeLimit) {
+    GC::init();
+    return Tree::template map_reduce_columns<R>(m.root, f, r, grain);
+  }
+
   template<class F>
   static void map_void(M& m, const F& f,
 		       size_t granularity=kNodeLimit) {
@@ -698,6 +770,11 @@ public:
     GC::print_stats();
   }
 
+  // Hot-path event counts for this map type, summed over all threads. They
+  // stay zero unless compiled with -DCPAM_STATS.
+  static op_counts op_stats() { return Tree::stats::counts(); }
+  static void reset_op_stats() { Tree::stats::reset(); }
+
 
 };
 
@@ -727,6 +804,12 @@ using pam_map = map_<
 template <class _Entry, size_t BlockSize=128, class Balance=weight_balanced_tree>
 using diff_encoded_map = pam_map<_Entry, BlockSize, diffencoded_entry_encoder, Balance>;
 
+template <class _Entry, size_t BlockSize=128, class Balance=weight_balanced_tree>
+using streamvbyte_map = pam_map<_Entry, BlockSize, streamvbyte_entry_encoder, Balance>;
+
+template <class _Entry, size_t BlockSize=128, class Balance=weight_balanced_tree>
+using bitpacked_map = pam_map<_Entry, BlockSize, bitpacked_entry_encoder, Balance>;
+
 // entry is just the key (no value), for use in sets
 template <class entry>
 struct set_full_entry : entry {
@@ -736,6 +819,7 @@ struct set_full_entry : entry {
   static inline key_t get_key(const entry_t& e) { return e; }
   static inline val_t get_val(const entry_t& e) { return 0; }
   static inline void set_val(entry_t& e, const val_t& v) {}
+  static inline entry_t to_entry(const key_t& k, const val_t& v) { return k; }
 };
 
 template <class _Entry, size_t BlockSize=256, class Encoder=default_entry_encoder, class Balance = weight_balanced_tree>
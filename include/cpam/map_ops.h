@@ -1,4 +1,6 @@
 #pragma once
+#include <memory>
+#include <vector>
 #include "utils.h"
 #include "parlay/primitives.h"
 #include "parlay/internal/binary_search.h"
@@ -31,15 +33,9 @@ struct map_ops : Seq {
   //static V get_val(node *s) { return Entry::get_val(Seq::get_entry(s));}
 
   static std::optional<ET> find_compressed(ptr b, const K& key) {
-    std::optional<ET> ret;
-    auto find_f = [&] (const ET& et) {
-      if (!(Entry::comp(key, Entry::get_key(et)) || Entry::comp(Entry::get_key(et), key))) {
-        ret = et;
-      }
-    };
-    Seq::iterate_seq(b.node_ptr(), find_f);
-    // TODO: should probably use decode_cond or something like this.
-    return ret;
+    auto f = [&] (const ET& et) { return Entry::get_key(et); };
+    // b keeps (and releases) its reference to the node.
+    return Seq::find_compressed(b.unsafe_ptr(), f, Entry::comp, key);
   }
 
   static std::optional<ET> find(ptr b, const K& key) {
@@ -114,13 +110,8 @@ struct map_ops : Seq {
   static size_t rank(node* b, const K& key, size_t sum=0) {
     if (!b) return sum;
     if (Seq::is_compressed(b)) {
-      auto fn = [&] (const auto& et) {
-        if (Entry::comp(Entry::get_key(et), key)) {
-          sum++;
-        }
-      };
-      Seq::iterate_seq(b, fn);
-      return sum;
+      auto f = [&] (const ET& et) { return Entry::get_key(et); };
+      return sum + Seq::rank_compressed(b, f, Entry::comp, key);
     }
     auto rb = Seq::cast_to_regular(b);
     if (Entry::comp(get_key(rb), key)) {
@@ -139,8 +130,26 @@ struct map_ops : Seq {
       : l(l), mid(mid), r(r) {};
   };
 
+  // Splits a block by decoding it once and binary searching for k. Each side
+  // becomes at most one new block (see Seq::array_to_node), instead of
+  // exposing the block as a tree of regular nodes and joining it back.
+  static split_info split_block(ptr a, const K& k) {
+    size_t n = a.size();
+    ET tmp[2*B];
+    ET* A = Seq::compressed_node_elms(a.unsafe_ptr(), tmp);
+    auto less = [&] (const ET& e) { return Entry::comp(Entry::get_key(e), k); };
+    size_t i = utils::PAM_binary_search(A, n, less);
+    bool found = (i < n) && !Entry::comp(k, Entry::get_key(A[i]));
+    std::optional<ET> mid = found ? std::optional<ET>(A[i]) : std::nullopt;
+    node* l = Seq::array_to_node(A, i);
+    node* r = Seq::array_to_node(A + i + found, n - i - found);
+    // a releases its reference to the block.
+    return split_info(l, mid, r);
+  }
+
   static split_info split(ptr a, const K& k) {
     if (a.empty()) return split_info(NULL, std::nullopt, NULL);
+    if (a.is_compressed()) return split_block(std::move(a), k);
     auto [lc, e, rc, m] = Seq::expose(std::move(a));
     const K& kmid = Entry::get_key(e);
 
@@ -329,7 +338,7 @@ struct map_ops : Seq {
 
     Seq2::GC::decrement(m2);
     if (sp1.mid) {
-      ET e(key,
+      ET e = Entry::to_entry(key,
            op(Seq1::Entry::get_val(*sp1.mid),
               Seq2::Entry::get_val(e2)));
       return Seq::join(l, e, r, nullptr);
@@ -535,6 +544,7 @@ struct map_ops : Seq {
   template <bool copy=false>
   static regular_node* make_node_tmpl(regular_node* x) {
     if constexpr (copy) {
+      Seq::stats::add(Seq::stats::kPathCopies);
       return Seq::make_regular_node(Seq::get_entry(x));
     }
     return x;
@@ -560,7 +570,7 @@ struct map_ops : Seq {
         break;
       } else {  // arr[k] == key
         parlay::assign_uninitialized(merged[out_off], arr[k++]);
-        combine_values(merged[out_off], e, true, f);
+        combine_values(merged[out_off], e, false, f);
         out_off++;
         placed = true;
         break;
@@ -587,10 +597,11 @@ struct map_ops : Seq {
           parlay::assign_uninitialized(merged[out_off++], et);
         } else if (Entry::comp(key, Entry::get_key(et))) {
           parlay::assign_uninitialized(merged[out_off++], e);
+          parlay::assign_uninitialized(merged[out_off++], et);
           placed = true;
         } else {  // get_key(et) == key
           parlay::assign_uninitialized(merged[out_off], et);
-          combine_values(merged[out_off], e, true, f);
+          combine_values(merged[out_off], e, false, f);
           out_off++;
           placed = true;
         }
@@ -756,7 +767,8 @@ struct map_ops : Seq {
 //  }
 
   static node* remove_compressed3(ptr b, const K& k) {
-    auto r = b.node_ptr();
+    // b keeps (and releases) its reference to the block.
+    auto r = b.unsafe_ptr();
     ET merged[2*B];
     size_t out_off = 0;
     auto merge = [&] (const ET& et) {
@@ -782,11 +794,11 @@ struct map_ops : Seq {
     K ek = Entry::get_key(e);
     if (Entry::comp(ek, k)) {
       regular_node* o = (root != nullptr) ? root : Seq::single(e);
-      auto ret = my_remove(std::move(rc), k, join);
+      auto ret = my_remove_2(std::move(rc), k, join);
       return join(lc.node_ptr(), ret, o);
     } else if (Entry::comp(k, ek)) {
       regular_node* o = (root != nullptr) ? root : Seq::single(e);
-      auto ret = my_remove(std::move(lc), k, join);
+      auto ret = my_remove_2(std::move(lc), k, join);
       return join(ret, rc.node_ptr(), o);
     }
     GC::decrement(root);
@@ -1297,6 +1309,17 @@ struct map_ops : Seq {
     if (n == 0) return true;
 
     if (Seq::is_compressed(b)) {
+      // Few keys in a large block: search for each key using the encoder's
+      // find instead of decoding the whole block.
+      size_t sz = Seq::size(b);
+      if (n * parlay::log2_up(sz) < sz) {
+        auto f = [&] (const ET& et) { return Entry::get_key(et); };
+        for (size_t i=0; i<n; i++) {
+          auto et = Seq::find_compressed(b, f, Entry::comp, A[i]);
+          if (et.has_value()) ret[offset + i] = Entry::get_val(*et);
+        }
+        return true;
+      }
       return multifind_sorted_bc(b, A, n, ret, offset);
     }
 
@@ -1314,6 +1337,206 @@ struct map_ops : Seq {
     return true;
   }
 
+  // Like map_reduce, but f(keys, vals, n) reduces n entries given as separate
+  // arrays of keys and values: a whole compressed block at a time, and single
+  // entries of regular nodes. vals is null for sets.
+  template<class R, class F>
+  static typename R::T map_reduce_columns(node* a, const F& f, const R& r,
+                                          size_t grain=Seq::kNodeLimit) {
+    using T = typename R::T;
+    constexpr bool kHasVals = !std::is_same_v<ET, K>;
+    if (a == nullptr) return r.identity();
+    if (Seq::is_compressed(a)) {
+      alignas(64) K keys[2*B];
+      alignas(64) V vals[kHasVals ? 2*B : 1];
+      V* vp = kHasVals ? vals : nullptr;
+      Seq::decode_columns(a, keys, vp);
+      return f((const K*)keys, (const V*)vp, Seq::size(a));
+    }
+
+    size_t size = Seq::size(a);
+    auto an = (regular_node*)a;
+    auto P = utils::fork<T>(size >= grain,
+      [&]() {return map_reduce_columns<R>(an->lc, f, r, grain);},
+      [&]() {return map_reduce_columns<R>(an->rc, f, r, grain);});
+
+    const ET& e = Seq::get_entry(a);
+    K k = Entry::get_key(e);
+    T v;
+    if constexpr (kHasVals) {
+      V val = Entry::get_val(e);
+      v = f((const K*)&k, (const V*)&val, 1);
+    } else {
+      v = f((const K*)&k, (const V*)nullptr, 1);
+    }
+    return R::add(P.first, r.add(v, P.second));
+  }
+
+  // Calls f on the entries of a block with keys in [low, high] (unbounded on
+  // a side whose flag is false), stopping at the first key above high.
+  template <class F>
+  static void range_block(node* a, const K& low, const K& high,
+                          bool check_low, bool check_high, const F& f) {
+    auto fn = [&] (const ET& e) {
+      const K& k = Entry::get_key(e);
+      if (check_high && Entry::comp(high, k)) return false;
+      if (!check_low || !Entry::comp(k, low)) f(e);
+      return true;
+    };
+    Seq::iterate_cond(a, fn);
+  }
+
+  // Applies f, in key order, to the entries with keys in [low, high] without
+  // building a tree: subtrees inside the range are iterated whole, and only
+  // the blocks holding the bounds are checked key by key.
+  template <class F>
+  static void range_foreach(node* a, const K& low, const K& high, const F& f,
+                            bool check_low=true, bool check_high=true) {
+    if (a == nullptr) return;
+    if (!check_low && !check_high) return Seq::iterate_seq(a, f);
+    if (Seq::is_compressed(a)) {
+      return range_block(a, low, high, check_low, check_high, f);
+    }
+    auto an = Seq::cast_to_regular(a);
+    const ET& e = Seq::get_entry(a);
+    const K& k = Entry::get_key(e);
+    if (check_low && Entry::comp(k, low)) {
+      return range_foreach(an->rc, low, high, f, check_low, check_high);
+    }
+    if (check_high && Entry::comp(high, k)) {
+      return range_foreach(an->lc, low, high, f, check_low, check_high);
+    }
+    range_foreach(an->lc, low, high, f, check_low, false);
+    f(e);
+    range_foreach(an->rc, low, high, f, false, check_high);
+  }
+
+  // map_reduce over the entries with keys in [low, high], without building
+  // a tree; subtrees inside the range go to map_reduce.
+  template<class R, class F>
+  static typename R::T range_map_reduce(node* a, const K& low, const K& high,
+                                        const F& f, const R& r,
+                                        size_t grain=Seq::kNodeLimit,
+                                        bool check_low=true,
+                                        bool check_high=true) {
+    using T = typename R::T;
+    if (a == nullptr) return r.identity();
+    if (!check_low && !check_high) {
+      return Seq::template map_reduce<R>(a, f, r, grain);
+    }
+    if (Seq::is_compressed(a)) {
+      T v = r.identity();
+      range_block(a, low, high, check_low, check_high,
+                  [&] (const ET& e) { v = R::add(v, f(e)); });
+      return v;
+    }
+    auto an = Seq::cast_to_regular(a);
+    const ET& e = Seq::get_entry(a);
+    const K& k = Entry::get_key(e);
+    if (check_low && Entry::comp(k, low)) {
+      return range_map_reduce<R>(an->rc, low, high, f, r, grain, check_low, check_high);
+    }
+    if (check_high && Entry::comp(high, k)) {
+      return range_map_reduce<R>(an->lc, low, high, f, r, grain, check_low, check_high);
+    }
+    auto P = utils::fork<T>(Seq::size(a) >= grain,
+      [&]() {return range_map_reduce<R>(an->lc, low, high, f, r, grain, check_low, false);},
+      [&]() {return range_map_reduce<R>(an->rc, low, high, f, r, grain, false, check_high);});
+    return R::add(P.first, r.add(f(e), P.second));
+  }
+
+  // In-order traversal for diff that hands out whole subtrees and only
+  // expands the one at the top when asked to. The top is a subtree, the
+  // entry of a regular node, or the next entry of the last decoded block.
+  struct diff_cursor {
+    std::vector<std::pair<node*, bool>> stack;  // (n, true): subtree of n
+    ET block[2*B];
+    size_t pos = 0, len = 0;
+
+    diff_cursor(node* a) { if (a) stack.push_back({a, true}); }
+
+    bool in_block() const { return pos < len; }
+    bool done() const { return !in_block() && stack.empty(); }
+    // The subtree at the top, or nullptr if the top is an entry.
+    node* top_tree() const {
+      return (!in_block() && stack.back().second) ? stack.back().first : nullptr;
+    }
+    const ET& top_entry() const {
+      return in_block() ? block[pos] : Seq::get_entry(stack.back().first);
+    }
+    void pop() {
+      if (in_block()) pos++;
+      else stack.pop_back();
+    }
+    void expand() {
+      node* a = stack.back().first;
+      stack.pop_back();
+      if (Seq::is_compressed(a)) {
+        pos = len = 0;
+        Seq::iterate_seq(a, [&] (const ET& e) { block[len++] = e; });
+      } else {
+        auto an = Seq::cast_to_regular(a);
+        if (an->rc) stack.push_back({an->rc, true});
+        stack.push_back({a, false});
+        if (an->lc) stack.push_back({an->lc, true});
+      }
+    }
+  };
+
+  // Calls, in key order, on_delete(e) for the entries of a whose keys are not
+  // in b, on_insert(e) for the entries of b whose keys are not in a, and
+  // on_update(ea, eb) for the keys in both whose values differ (compared
+  // with ==). Subtrees that a and b share (the same node) are skipped
+  // without being visited, so for two versions of a map the work is
+  // proportional to the nodes on the paths to the changes, not to the size.
+  // Sequential; neither tree is modified.
+  template <class FI, class FD, class FU>
+  static void diff(node* a, node* b, const FI& on_insert, const FD& on_delete,
+                   const FU& on_update) {
+    constexpr bool kHasVals = !std::is_same_v<ET, K>;
+    auto ca = std::make_unique<diff_cursor>(a);
+    auto cb = std::make_unique<diff_cursor>(b);
+    while (!ca->done() && !cb->done()) {
+      node* ta = ca->top_tree();
+      node* tb = cb->top_tree();
+      if (ta && ta == tb) {
+        ca->pop(); cb->pop();
+      } else if (ta && tb) {
+        // the larger subtree may contain the other one
+        if (Seq::size(ta) >= Seq::size(tb)) ca->expand();
+        else cb->expand();
+      } else if (ta) {
+        ca->expand();
+      } else if (tb) {
+        cb->expand();
+      } else {
+        const ET& ea = ca->top_entry();
+        const ET& eb = cb->top_entry();
+        const K& ka = Entry::get_key(ea);
+        const K& kb = Entry::get_key(eb);
+        if (Entry::comp(ka, kb)) {
+          on_delete(ea); ca->pop();
+        } else if (Entry::comp(kb, ka)) {
+          on_insert(eb); cb->pop();
+        } else {
+          if constexpr (kHasVals) {
+            if (!(Entry::get_val(ea) == Entry::get_val(eb))) on_update(ea, eb);
+          }
+          ca->pop(); cb->pop();
+        }
+      }
+    }
+    auto drain = [] (diff_cursor& c, const auto& f) {
+      while (!c.done()) {
+        if (node* t = c.top_tree()) Seq::iterate_seq(t, f);
+        else f(c.top_entry());
+        c.pop();
+      }
+    };
+    drain(*ca, on_delete);
+    drain(*cb, on_insert);
+  }
+
   template<class InTree, class Func>
   static node* map(typename InTree::ptr b, const Func& f) {
     auto g = [&] (typename InTree::ET& a) {
@@ -1391,11 +1614,32 @@ struct map_ops : Seq {
     }
   }
 
+  // Base case for two compressed set leaves whose encoder can combine the
+  // encoded blocks directly (see block_set_op). Consumes a and b and returns
+  // true with the result in ret, or returns false leaving a and b untouched.
+  static bool block_set_op_bc(block_set_op op, node* a, node* b, node*& ret) {
+    if constexpr (std::is_same_v<ET, K> && Seq::kBlockSetOps) {
+      K out[kBaseCaseSize + 1];
+      long n = Seq::set_op_compressed(op, a, b, out);
+      if (n < 0) return false;
+      Seq::decrement_recursive(a);
+      Seq::decrement_recursive(b);
+      if (n == 0) ret = nullptr;
+      else if ((size_t)n < B) ret = Seq::to_tree_impl(out, n);
+      else ret = Seq::make_compressed(out, n);
+      return true;
+    }
+    return false;
+  }
+
   template <class BinaryOp>
   static node* union_bc(ptr b1, ptr b2, const BinaryOp& op) {
     auto n_b1 = b1.node_ptr();
     auto n_b2 = b2.node_ptr();
 
+    node* ret;
+    if (block_set_op_bc(block_set_op::union_op, n_b1, n_b2, ret)) return ret;
+
     ET stack[kBaseCaseSize + 1];
     size_t offset = 0;
     auto copy_f = [&] (ET a) {  // TODO: copy or ref?
@@ -1454,6 +1698,9 @@ struct map_ops : Seq {
     auto n_b1 = b1.node_ptr();
     auto n_b2 = b2.node_ptr();
 
+    node* ret;
+    if (block_set_op_bc(block_set_op::difference_op, n_b1, n_b2, ret)) return ret;
+
     ET stack[kBaseCaseSize + 1];
     size_t offset = 0;
     auto copy_f = [&] (ET a) {  // TODO: copy or ref?
@@ -1504,6 +1751,11 @@ struct map_ops : Seq {
     auto n_b1 = b1.node_ptr();
     auto n_b2 = b2.node_ptr();
 
+    if constexpr (std::is_same_v<Seq1, map_ops> && std::is_same_v<Seq2, map_ops>) {
+      node* ret;
+      if (block_set_op_bc(block_set_op::intersect_op, n_b1, n_b2, ret)) return ret;
+    }
+
     ET stack[kBaseCaseSize + 1];
     size_t offset = 0;
     auto copy_f = [&] (ET a) {  // TODO: copy or ref?
@@ -0,0 +1,124 @@
+#pragma once
+#include <atomic>
+#include <vector>
+
+#include "parlay/parallel.h"
+
+#ifdef CPAM_NUMA
+#include <numa.h>
+#include <numaif.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+// *******************************************
+//   NUMA PLACEMENT
+// *******************************************
+
+// Compile with -DCPAM_NUMA (and link with -lnuma) to place large trees and
+// schedule their traversals by NUMA node. Without it, or on a machine
+// without NUMA support, there is a single node and every function below
+// reduces to the plain parallel version.
+
+namespace cpam {
+namespace numa_utils {
+
+#ifdef CPAM_NUMA
+static constexpr bool kEnabled = true;
+#else
+static constexpr bool kEnabled = false;
+#endif
+
+// Trees smaller than this are neither placed nor traversed by node.
+static constexpr size_t kMinSize = 1 << 20;
+
+static inline bool available() {
+#ifdef CPAM_NUMA
+  static bool ok = (numa_available() >= 0);
+  return ok;
+#else
+  return false;
+#endif
+}
+
+static inline int num_nodes() {
+#ifdef CPAM_NUMA
+  if (available()) return numa_num_configured_nodes();
+#endif
+  return 1;
+}
+
+// The node of the CPU the calling thread is running on.
+static inline int current_node() {
+#ifdef CPAM_NUMA
+  if (available()) {
+    int node = numa_node_of_cpu(sched_getcpu());
+    if (node >= 0) return node;
+  }
+#endif
+  return 0;
+}
+
+// The node holding the page of p (0 if unknown).
+static inline int node_of(const void* p) {
+#ifdef CPAM_NUMA
+  if (available() && p) {
+    int node = -1;
+    if (get_mempolicy(&node, nullptr, 0, const_cast<void*>(p),
+                      MPOL_F_NODE | MPOL_F_ADDR) == 0 && node >= 0) {
+      return node;
+    }
+  }
+#endif
+  return 0;
+}
+
+// Moves the pages holding the given addresses to node. Best effort: pages
+// that can not be moved stay where they are.
+static inline void move_to_node(std::vector<void*>& addrs, int node) {
+#ifdef CPAM_NUMA
+  if (!available() || addrs.empty()) return;
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  std::vector<void*> pages;
+  pages.reserve(addrs.size());
+  for (void* a : addrs) {
+    void* p = (void*)((size_t)a & ~(page - 1));
+    if (pages.empty() || pages.back() != p) pages.push_back(p);
+  }
+  std::vector<int> nodes(pages.size(), node), status(pages.size());
+  numa_move_pages(0, pages.size(), pages.data(), nodes.data(), status.data(),
+                  MPOL_MF_MOVE);
+#endif
+}
+
+// Runs f(i) for i in [0, n) in parallel, preferring to run f(i) on a worker
+// of node owner(i). Each worker first takes the items of the node it is
+// running on, then helps with those of the other nodes.
+template <class Owner, class F>
+static void run_by_node(size_t n, const Owner& owner, const F& f) {
+  int nodes = num_nodes();
+  if (nodes <= 1) {
+    parlay::parallel_for(0, n, [&] (size_t i) { f(i); }, 1);
+    return;
+  }
+  std::vector<std::vector<size_t>> items(nodes);
+  for (size_t i = 0; i < n; i++) {
+    int o = owner(i);
+    items[(o >= 0 && o < nodes) ? o : 0].push_back(i);
+  }
+  std::vector<std::atomic<size_t>> next(nodes);
+  for (auto& x : next) x.store(0);
+  auto drain = [&] (int node) {
+    auto& v = items[node];
+    size_t j;
+    while ((j = next[node].fetch_add(1)) < v.size()) f(v[j]);
+  };
+  parlay::parallel_for(0, parlay::num_workers(), [&] (size_t) {
+    int home = current_node() % nodes;
+    drain(home);
+    for (int k = 1; k < nodes; k++) drain((home + k) % nodes);
+  }, 1);
+}
+
+}  // namespace numa_utils
+}  // namespace cpam
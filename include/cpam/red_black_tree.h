@@ -0,0 +1,231 @@
+#pragma once
+#include "balance_utils.h"
+
+// *******************************************
+//   RED BLACK TREES
+//   From the paper:
+//   Just Join for Parallel Ordered Sets
+//   G. Blelloch, D. Ferizovic, and Y. Sun
+//   SPAA 2016
+// *******************************************
+
+namespace cpam {
+
+struct red_black_tree {
+
+  enum Color : unsigned char { RED, BLACK };
+
+  // height is the black height
+  struct data { unsigned char height; Color color; };
+
+  // Blocks are black leaves of black height 1. Pieces too small to be a
+  // child (see balance_utils) are merged into the leaf at the end of the
+  // other tree's spine; if that makes two blocks, their root is red so the
+  // black height does not change, as for the red node of an insertion.
+  //
+  // defines: node_join, regular_node_join, is_balanced, check_structure
+  // redefines: update, make_regular_node, single, make_compressed
+  template<class Node>
+  struct balance : public Node {
+    using node = typename Node::node;
+    using regular_node = typename Node::regular_node;
+    using t_utils = balance_utils<balance>;
+    using GC = gc<balance>;
+    using ET = typename Node::ET;
+    using Node::B;
+    friend t_utils;
+
+    static node* node_join(node* t1, node* t2, regular_node* k) {
+      if (t_utils::is_small_join(t1, t2)) return t_utils::small_join(t1, t2, k);
+      return join<true>(t1, t2, k);
+    }
+
+    // For trees of regular nodes only.
+    static regular_node* regular_node_join(regular_node* t1, regular_node* t2, regular_node* k) {
+      return Node::cast_to_regular(join<false>(t1, t2, k));
+    }
+
+    static inline bool is_balanced(regular_node* t) {
+      return !t || ((t->color == BLACK ||
+                     (color(t->lc) == BLACK && color(t->rc) == BLACK)) &&
+                    height(t->lc) == height(t->rc));
+    }
+
+    static void update(node* t) {
+      Node::update(t);
+      auto r = Node::cast_to_regular(t);
+      r->height = height(r->lc) + (r->color == BLACK);
+    }
+
+    template <class F>
+    static void lazy_update(node* t, const F& f) {
+      Node::lazy_update(t, f);
+      auto r = Node::cast_to_regular(t);
+      r->height = height(r->lc) + (r->color == BLACK);
+    }
+
+    static regular_node* make_regular_node(const ET& e) {
+      regular_node* o = Node::make_regular_node(e);
+      o->height = 1;
+      o->color = BLACK;
+      return o;
+    }
+
+    static regular_node* single(const ET& e) {
+      regular_node* o = Node::single(e);
+      o->height = 1;
+      o->color = BLACK;
+      return o;
+    }
+
+    // The regular nodes made by Node::make_compressed have no color yet.
+    static node* make_compressed(node* l, node* r, regular_node* e) {
+      return set_colors(Node::make_compressed(l, r, e));
+    }
+
+    static node* make_compressed(ET* stack, size_t tot) {
+      return set_colors(Node::make_compressed(stack, tot));
+    }
+
+    static node* make_compressed(node* l, node* r) {
+      return make_compressed(l, r, nullptr);
+    }
+
+    static bool check_structure(node* b, size_t orig_tree_size = std::numeric_limits<size_t>::max()) {
+      return t_utils::check_structure(b, orig_tree_size);
+    }
+
+  private:
+    static int height(node* a) {
+      if (a == NULL) return 0;
+      if (Node::is_compressed(a)) return 1;
+      return Node::cast_to_regular(a)->height;
+    }
+
+    static Color color(node* a) {
+      if (a == NULL || Node::is_compressed(a)) return BLACK;
+      return Node::cast_to_regular(a)->color;
+    }
+
+    static regular_node* set_color(regular_node* t, Color c) {
+      t->color = c;
+      update(t);
+      return t;
+    }
+
+    // Colors the (at most three) regular nodes above the blocks made by
+    // Node::make_compressed. A root over a block and a two-block node makes
+    // the latter red.
+    static node* set_colors(node* a) {
+      if (a && Node::is_regular(a)) {
+        auto r = Node::cast_to_regular(a);
+        set_colors(r->lc);
+        set_colors(r->rc);
+        if (height(r->lc) != height(r->rc)) {
+          node* c = height(r->lc) > height(r->rc) ? r->lc : r->rc;
+          set_color(Node::cast_to_regular(c), RED);
+        }
+        set_color(r, BLACK);
+      }
+      return a;
+    }
+
+    static bool check_node(regular_node* t) {
+      return is_balanced(t) &&
+             t->height == height(t->lc) + (t->color == BLACK);
+    }
+
+    static node* balanced_join(node* l, node* r, regular_node* k, Color c) {
+      k->lc = l;
+      k->rc = r;
+      k->color = c;
+      update(k);
+      return k;
+    }
+
+    // A red root becomes black, which keeps the tree valid and makes the
+    // descent in right_join / left_join stop at a black node.
+    static node* blacken(node* t) {
+      if (color(t) == RED) {
+        t = set_color(Node::cast_to_regular(GC::copy_if_needed(t)), BLACK);
+      }
+      return t;
+    }
+
+    // kLeaves: the trees can contain blocks and small pieces.
+    template <bool kLeaves>
+    static node* join(node* t1, node* t2, regular_node* k) {
+      t1 = blacken(t1);
+      t2 = blacken(t2);
+      bool small1 = kLeaves && t_utils::is_small(t1);
+      bool small2 = kLeaves && t_utils::is_small(t2);
+      if (small2 || (!small1 && height(t1) > height(t2))) {
+        auto t = Node::cast_to_regular(right_join<kLeaves>(t1, t2, k));
+        if (t->color == RED && color(t->rc) == RED) set_color(t, BLACK);
+        return t;
+      }
+      if (small1 || height(t2) > height(t1)) {
+        auto t = Node::cast_to_regular(left_join<kLeaves>(t1, t2, k));
+        if (t->color == RED && color(t->lc) == RED) set_color(t, BLACK);
+        return t;
+      }
+      return balanced_join(t1, t2, k, RED);
+    }
+
+    // Returns a tree of the black height of t1 whose root can be red with a
+    // red right child.
+    template <bool kLeaves>
+    static node* right_join(node* t1, node* t2, regular_node* k) {
+      if (kLeaves && t_utils::is_small(t2)) {
+        if (Node::is_compressed(t1)) {
+          node* t = t_utils::small_join(t1, t2, k);
+          if (Node::is_regular(t)) set_color(Node::cast_to_regular(t), RED);
+          return t;
+        }
+      } else if (height(t1) == height(t2) && color(t1) == BLACK) {
+        return balanced_join(t1, t2, k, RED);
+      }
+      regular_node* t = Node::cast_to_regular(GC::copy_if_needed(t1));
+      t->rc = right_join<kLeaves>(t->rc, t2, k);
+
+      // rebalance if needed
+      if (t->color == BLACK && color(t->rc) == RED &&
+          color(Node::cast_to_regular(t->rc)->rc) == RED) {
+        auto rr = Node::cast_to_regular(Node::cast_to_regular(t->rc)->rc);
+        set_color(rr, BLACK);
+        t = t_utils::rotate_left(t);
+      } else {
+        update(t);
+      }
+      return t;
+    }
+
+    template <bool kLeaves>
+    static node* left_join(node* t1, node* t2, regular_node* k) {
+      if (kLeaves && t_utils::is_small(t1)) {
+        if (Node::is_compressed(t2)) {
+          node* t = t_utils::small_join(t1, t2, k);
+          if (Node::is_regular(t)) set_color(Node::cast_to_regular(t), RED);
+          return t;
+        }
+      } else if (height(t1) == height(t2) && color(t2) == BLACK) {
+        return balanced_join(t1, t2, k, RED);
+      }
+      regular_node* t = Node::cast_to_regular(GC::copy_if_needed(t2));
+      t->lc = left_join<kLeaves>(t1, t->lc, k);
+
+      // rebalance if needed
+      if (t->color == BLACK && color(t->lc) == RED &&
+          color(Node::cast_to_regular(t->lc)->lc) == RED) {
+        auto ll = Node::cast_to_regular(Node::cast_to_regular(t->lc)->lc);
+        set_color(ll, BLACK);
+        t = t_utils::rotate_right(t);
+      } else {
+        update(t);
+      }
+      return t;
+    }
+  };
+};
+
+}  // namespace cpam
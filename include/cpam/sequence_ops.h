@@ -1,5 +1,6 @@
 #pragma once
 #include "gc.h"
+#include "numa_utils.h"
 #include "utils.h"
 
 // *******************************************
@@ -49,6 +50,35 @@ struct sequence_ops : Tree {
     return to_tree_impl(arr, arr_size);
   }
 
+  // The n entries of A as one block, or as a tree of regular nodes if there
+  // are fewer than B of them. n must be at most 2B.
+  static node* array_to_node(ET* A, size_t n) {
+    assert(n <= 2*B);
+    if (n < B) return to_tree_impl(A, n);
+    return Tree::make_compressed(A, n);
+  }
+
+  // Concatenates two trees of at most 2B entries each, at least one of them
+  // a block, by decoding both once into an array. Returns at most two blocks
+  // (under a regular root) rather than exposing either side as a tree.
+  // Consumes b1 and b2.
+  static node* concat_blocks(node* b1, node* b2) {
+    size_t n = Tree::size(b1) + Tree::size(b2);
+    assert(Tree::size(b1) <= 2*B && Tree::size(b2) <= 2*B);
+    ET stack[4*B];
+    size_t offset = 0;
+    auto copy_f = [&] (const ET& e) {
+      parlay::assign_uninitialized(stack[offset++], e);
+    };
+    Tree::iterate_seq(b1, copy_f);
+    Tree::iterate_seq(b2, copy_f);
+    assert(offset == n);
+    GC::decrement_recursive(b1);
+    GC::decrement_recursive(b2);
+    if (n <= 2*B) return array_to_node(stack, n);
+    return Tree::make_compressed(stack, n);
+  }
+
   static expose_simple_tuple expose_simple(node* p) {
     if (Tree::is_regular(p)) {
       regular_node* rp = (regular_node*)p;
@@ -85,6 +115,7 @@ struct sequence_ops : Tree {
       //  };
       //  Tree::iterate_seq(p, fn);
       //}
+      Tree::stats::add(Tree::stats::kExposes);
       regular_node* root = to_tree((compressed_node*)p);
       //if (print) {
       //  auto fn = [&] (const auto& et) {
@@ -129,20 +160,9 @@ struct sequence_ops : Tree {
     return Tree::is_balanced(a) && P.first && P.second;
   }
 
-  // TODO: add base case.
   static std::optional<ET> select_compressed(node* a, size_t rank) {
-    size_t i=0;
-    std::optional<ET> ret;
-    auto fn = [&] (const ET& a) -> bool {
-      if (i == rank) {
-        ret = a;
-        return false;
-      }
-      i++;
-      return true;
-    };
-    Tree::iterate_cond(a, fn);
-    return ret;
+    if (rank >= Tree::size(a)) return {};
+    return Tree::select_compressed(a, rank);
   }
 
   // TODO: add base case.
@@ -338,7 +358,7 @@ struct sequence_ops : Tree {
 
     if (b1.size() > b2.size()) {
       if (b1.is_compressed() || Tree::will_be_compressed(b1.size() + b2.size())) {
-        auto ret = Tree::make_compressed(b1.node_ptr(), b2.node_ptr());
+        auto ret = concat_blocks(b1.node_ptr(), b2.node_ptr());
 //        Tree::check_structure(ret);
         return ret;
       }
@@ -350,7 +370,7 @@ struct sequence_ops : Tree {
       return ret;
     } else {
       if (b2.is_compressed() || Tree::will_be_compressed(b1.size() + b2.size())) {
-        return Tree::make_compressed(b1.node_ptr(), b2.node_ptr());
+        return concat_blocks(b1.node_ptr(), b2.node_ptr());
       }
       auto[lc, e, rc, root] = expose(std::move(b2));
       node* l = join2_i(std::move(b1), std::move(lc));
@@ -545,12 +565,17 @@ struct sequence_ops : Tree {
     if (a.empty()) return;
     if (a.is_compressed()) {
       auto c = a.unsafe_ptr();  // Why unsafe ptr here?? node_ptr() causes ref_cnt bumps.
-      size_t i = 0;
-      auto fn = [&] (ET a) {
-        f(a, start + i);
-        i++;
+      auto fn = [&] (const ET* E, size_t n) {
+        for (size_t i=0; i<n; i++) {
+          if constexpr (std::is_invocable_v<const F&, const ET&, size_t>) {
+            f(E[i], start + i);
+          } else {  // f takes a mutable entry: pass it a copy
+            ET e = E[i];
+            f(e, start + i);
+          }
+        }
       };
-      Tree::iterate_seq(c, fn);
+      Tree::decode_block(c, fn);
       return;
     }
     auto[lc, e, rc, root] = expose(std::move(a));
@@ -648,11 +673,19 @@ struct sequence_ops : Tree {
 
     auto b1_node = b1.node_ptr();
     size_t offset = 0;
-    auto copy_f = [&] (ET a) {  // needs to be a copy since we move
-      if (f(a))
-        parlay::move_uninitialized(stack[offset++], a);
+    auto copy_f = [&] (const ET* E, size_t n) {
+      for (size_t i=0; i<n; i++) {
+        if constexpr (std::is_invocable_v<const Func&, const ET&>) {
+          if (f(E[i]))
+            parlay::assign_uninitialized(stack[offset++], E[i]);
+        } else {  // f takes a mutable entry: pass it a copy
+          ET e = E[i];
+          if (f(e))
+            parlay::move_uninitialized(stack[offset++], e);
+        }
+      }
     };
-    Tree::iterate_seq(b1_node, copy_f);
+    Tree::decode_block(b1_node, copy_f);
     assert(offset <= kBaseCaseSize);
 
     Tree::decrement_recursive(b1_node);
@@ -710,24 +743,55 @@ struct sequence_ops : Tree {
 //	return P.first || P.second;
 //  }
 
-  // Assumes the input is sorted and there are no duplicate keys
-  static node* from_array(ET* A, size_t n) {
+  // Builds a tree over fewer than B entries (no compressed nodes).
+  static node* from_array_small(ET* A, size_t n) {
     if (n <= 0) return Tree::empty();
     if (n == 1) return Tree::single(A[0]);
-    if (n >= B && n <= 2*B) {
-      return Tree::make_compressed(A, n);
-    }
     size_t mid = n/2;
-
     regular_node* m = Tree::make_regular_node(A[mid]);
+    node* l = from_array_small(A, mid);
+    node* r = from_array_small(A+mid+1, n-mid-1);
+    return Tree::node_join(l, r, m);
+  }
 
-    auto P = utils::fork<node*>(n >= kNodeLimit,
-      [&]() {return from_array(A, mid);},
-      [&]() {return from_array(A+mid+1, n-mid-1);});
-
+  // Links the already built leaves [lo, hi) under regular nodes holding the
+  // separators between them. Leaf i starts at A[start(i)] and is followed by
+  // its separator.
+  template <class Start>
+  static node* link_leaves(ET* A, node** leaves, size_t lo, size_t hi,
+                           const Start& start) {
+    if (hi - lo == 1) return leaves[lo];
+    size_t mid = (lo + hi) / 2;
+    regular_node* m = Tree::make_regular_node(A[start(mid) - 1]);
+    auto P = utils::fork<node*>(start(hi) - start(lo) >= kNodeLimit,
+      [&]() {return link_leaves(A, leaves, lo, mid, start);},
+      [&]() {return link_leaves(A, leaves, mid, hi, start);});
     return Tree::node_join(P.first, P.second, m);
   }
 
+  // Assumes the input is sorted and there are no duplicate keys.
+  // Cuts A into L leaves of B..2B entries separated by single entries, encodes
+  // all leaves in parallel straight from A, and then links them bottom-up.
+  // Adjacent subtrees differ by at most one leaf, so the joins never rotate.
+  static node* from_array(ET* A, size_t n) {
+    if (n < B) return from_array_small(A, n);
+    // The smallest L with (n+1-L)/L <= 2B; for n >= B the average leaf then
+    // also holds at least B entries.
+    size_t L = (n + 1 + 2*B) / (2*B + 1);
+    size_t q = (n + 1 - L) / L, rem = (n + 1 - L) % L;
+    auto start = [&] (size_t i) { return i*(q+1) + std::min(i, rem); };
+
+    node** leaves = utils::new_array_no_init<node*>(L);
+    parlay::parallel_for(0, L, [&] (size_t i) {
+      size_t s = start(i);
+      leaves[i] = Tree::make_single_compressed_node(A + s, start(i+1) - s - 1);
+    }, std::max<size_t>(1, kNodeLimit / (2*B)));
+
+    node* ret = link_leaves(A, leaves, 0, L, start);
+    utils::free_array(leaves, L);
+    return ret;
+  }
+
 // TODO
 //  template<class Seq1, class Func>
 //  static node* map_filter(typename Seq1::node* b, const Func& f,
@@ -752,10 +816,17 @@ struct sequence_ops : Tree {
     if (a == nullptr) return r.identity();
     if (Tree::is_compressed(a)) {
       T v = r.identity();
-      auto fn = [&] (ET a) {
-        v = R::add(v, f(a));
+      auto fn = [&] (const ET* E, size_t n) {
+        for (size_t i=0; i<n; i++) {
+          if constexpr (std::is_invocable_v<F&, const ET&>) {
+            v = R::add(v, f(E[i]));
+          } else {  // f takes a mutable entry: pass it a copy
+            ET e = E[i];
+            v = R::add(v, f(e));
+          }
+        }
       };
-      Tree::iterate_seq(a, fn);
+      Tree::decode_block(a, fn);
       return v;
     }
 
@@ -769,6 +840,152 @@ struct sequence_ops : Tree {
     return R::add(P.first, r.add(v, P.second));
   }
 
+  /* ================================ NUMA ================================ */
+
+  // With CPAM_NUMA, trees of at least numa_utils::kMinSize entries are cut
+  // into parts: blocks and subtrees of fewer than grain entries, where
+  // grain leaves about 8 parts per worker. Placement moves each part to one
+  // node, and traversals run each part on the node that holds its root,
+  // then handle the few regular nodes above the parts in order.
+  static bool use_numa(node* a) {
+    return numa_utils::kEnabled && Tree::size(a) >= numa_utils::kMinSize;
+  }
+
+  static size_t numa_grain(node* a, size_t grain) {
+    return std::max(grain, Tree::size(a) / (8 * parlay::num_workers()));
+  }
+
+  static bool is_numa_part(node* a, size_t grain) {
+    return !a || Tree::is_compressed(a) || Tree::size(a) < grain;
+  }
+
+  // Appends the parts of a, in order, and the index of their first entry.
+  static void numa_parts(node* a, size_t grain, size_t start,
+                         std::vector<node*>& parts, std::vector<size_t>& starts) {
+    if (is_numa_part(a, grain)) {
+      parts.push_back(a);
+      starts.push_back(start);
+      return;
+    }
+    auto an = Tree::cast_to_regular(a);
+    numa_parts(an->lc, grain, start, parts, starts);
+    numa_parts(an->rc, grain, start + Tree::size(an->lc) + 1, parts, starts);
+  }
+
+  template <class F>
+  static void run_parts(std::vector<node*>& parts, const F& f) {
+    numa_utils::run_by_node(parts.size(),
+        [&] (size_t i) { return numa_utils::node_of(parts[i]); }, f);
+  }
+
+  static void node_addresses(node* a, std::vector<void*>& out) {
+    if (!a) return;
+    out.push_back(a);
+    if (Tree::is_compressed(a)) {
+      out.push_back((uint8_t*)a + Tree::cast_to_compressed(a)->size_in_bytes - 1);
+      return;
+    }
+    auto an = Tree::cast_to_regular(a);
+    node_addresses(an->lc, out);
+    node_addresses(an->rc, out);
+  }
+
+  // Moves the pages of each part of a to the node of the worker that
+  // handles the part, so that a part does not straddle nodes. Pages shared
+  // with other parts (or other trees) follow the last part that moves them.
+  static void numa_place(node* a) {
+    if (!use_numa(a)) return;
+    std::vector<node*> parts;
+    std::vector<size_t> starts;
+    numa_parts(a, numa_grain(a, kNodeLimit), 0, parts, starts);
+    parlay::parallel_for(0, parts.size(), [&] (size_t i) {
+      std::vector<void*> addrs;
+      node_addresses(parts[i], addrs);
+      numa_utils::move_to_node(addrs, numa_utils::current_node());
+    }, 1);
+  }
+
+  template<class R, class F>
+  static typename R::T map_reduce_top(node* a, F& f, const R& r, size_t grain,
+                                      parlay::sequence<typename R::T>& res,
+                                      size_t& i) {
+    using T = typename R::T;
+    if (is_numa_part(a, grain)) return res[i++];
+    auto an = Tree::cast_to_regular(a);
+    T lv = map_reduce_top<R>(an->lc, f, r, grain, res, i);
+    T rv = map_reduce_top<R>(an->rc, f, r, grain, res, i);
+    T v = f(Tree::get_entry(a));
+    return R::add(lv, r.add(v, rv));
+  }
+
+  template<class R, class F>
+  static typename R::T map_reduce_numa(node* a, F f, R r,
+                                       size_t grain=kNodeLimit) {
+    size_t g = numa_grain(a, grain);
+    std::vector<node*> parts;
+    std::vector<size_t> starts;
+    numa_parts(a, g, 0, parts, starts);
+    auto res = parlay::sequence<typename R::T>(parts.size(), r.identity());
+    run_parts(parts, [&] (size_t i) {
+      res[i] = map_reduce<R>(parts[i], f, r, grain);
+    });
+    size_t i = 0;
+    return map_reduce_top<R>(a, f, r, g, res, i);
+  }
+
+  template <typename F>
+  static void foreach_index_top(node* a, size_t start, const F& f,
+                                size_t grain) {
+    if (is_numa_part(a, grain)) return;
+    auto an = Tree::cast_to_regular(a);
+    size_t lsize = Tree::size(an->lc);
+    f(Tree::get_entry(an), start + lsize);
+    foreach_index_top(an->lc, start, f, grain);
+    foreach_index_top(an->rc, start + lsize + 1, f, grain);
+  }
+
+  // Like foreach_index on ptr(a, true).
+  template <typename F>
+  static void foreach_index_numa(node* a, size_t start, const F& f,
+                                 size_t granularity = kNodeLimit) {
+    size_t g = numa_grain(a, granularity);
+    std::vector<node*> parts;
+    std::vector<size_t> starts;
+    numa_parts(a, g, start, parts, starts);
+    run_parts(parts, [&] (size_t i) {
+      foreach_index(ptr(parts[i], true), starts[i], f, granularity);
+    });
+    foreach_index_top(a, start, f, g);
+  }
+
+  template<class Func>
+  static node* filter_top(node* a, const Func& f, size_t grain,
+                          parlay::sequence<node*>& res, size_t& i) {
+    if (is_numa_part(a, grain)) return res[i++];
+    auto an = Tree::cast_to_regular(a);
+    node* l = filter_top(an->lc, f, grain, res, i);
+    node* r = filter_top(an->rc, f, grain, res, i);
+    ET e = Tree::get_entry(an);
+    if (f(e)) return join(l, e, r, nullptr);
+    return join2(l, r);
+  }
+
+  // Like filter on ptr(a, true): the caller keeps its reference to a.
+  template<class Func>
+  static node* filter_numa(node* a, const Func& f,
+                           size_t granularity=kNodeLimit) {
+    size_t g = numa_grain(a, granularity);
+    std::vector<node*> parts;
+    std::vector<size_t> starts;
+    numa_parts(a, g, 0, parts, starts);
+    auto res = parlay::sequence<node*>(parts.size(), nullptr);
+    run_parts(parts, [&] (size_t i) {
+      res[i] = filter(ptr(parts[i], true), f, granularity);
+    });
+    size_t i = 0;
+    return filter_top(a, f, g, res, i);
+  }
+
 // TODO
 //  template<class F, class T>
 //  static void semi_map_reduce_seq(node* b, T& v, F& f) {
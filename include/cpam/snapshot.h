@@ -0,0 +1,213 @@
+#pragma once
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+
+namespace cpam {
+
+// *******************************************
+//   SNAPSHOTS
+// *******************************************
+
+// Entries (and augmented values) that can be written and read back as raw
+// bytes. Weaker than trivially copyable, which std::tuple never is.
+template <class T>
+constexpr bool snapshot_storable = std::is_trivially_copy_constructible_v<T> &&
+                                   std::is_trivially_destructible_v<T>;
+
+// On-disk snapshot of a tree whose entries are snapshot_storable.
+//
+// Layout: a snapshot_header, then every compressed node written verbatim
+// (each starting at a multiple of kAlign), then the spine: the regular
+// nodes in preorder. A spine record is a one-byte tag followed by the
+// entry (and balance data) of a regular node, or by the file offset of a
+// compressed node.
+//
+// open() maps the file privately and uses the compressed nodes in place.
+// They are stored with a pinned reference count (kPinned), so they are
+// never freed and every update copies them (through the usual
+// ref_cnt() > 1 checks) instead of modifying them in place; writes to the
+// reference counts only dirty the touched pages of the private mapping.
+// The regular nodes are rebuilt in memory. The mapping stays alive for the
+// rest of the process.
+template <class Tree>
+struct snapshot_ops {
+  using node = typename Tree::node;
+  using regular_node = typename Tree::regular_node;
+  using ET = typename Tree::ET;
+  using balance_t = typename Tree::balance_t;
+
+  static constexpr char kMagic[8] = {'C', 'P', 'A', 'M', 'S', 'N', 'P', '1'};
+  static constexpr uint64_t kVersion = 1;
+  static constexpr size_t kAlign = 64;
+  static constexpr node_size_t kPinned = Tree::kTopBit >> 1;
+  // Regular nodes also store the balancing scheme's data, if it has any.
+  static constexpr size_t kBalanceBytes =
+      std::is_empty_v<balance_t> ? 0 : sizeof(balance_t);
+
+  enum tag : uint8_t { kEmpty = 0, kRegular = 1, kCompressed = 2 };
+
+  struct snapshot_header {
+    char magic[8];
+    uint64_t version;
+    uint64_t type_hash;   // hash of the tree type's name
+    uint64_t block_size;  // B
+    uint64_t entry_bytes; // sizeof(ET)
+    uint64_t num_entries;
+    uint64_t spine_offset;
+    uint64_t spine_bytes;
+  };
+
+  // FNV-1a over the mangled type name; catches opening a snapshot with a
+  // different entry, encoder or block size.
+  static uint64_t type_hash() {
+    uint64_t h = 14695981039346656037ULL;
+    for (const char* c = typeid(Tree).name(); *c; c++) {
+      h = (h ^ (uint8_t)*c) * 1099511628211ULL;
+    }
+    return h;
+  }
+
+  static size_t round_up(size_t n) { return (n + kAlign - 1) / kAlign * kAlign; }
+
+  static void write_spine(node* a, std::ofstream& out, std::string& spine,
+                          size_t& offset) {
+    if (!a) {
+      spine.push_back((char)kEmpty);
+    } else if (Tree::is_regular(a)) {
+      auto r = Tree::cast_to_regular(a);
+      spine.push_back((char)kRegular);
+      spine.append((const char*)&Tree::get_entry(a), sizeof(ET));
+      if constexpr (kBalanceBytes > 0) {
+        spine.append((const char*)static_cast<balance_t*>(r), kBalanceBytes);
+      }
+      write_spine(r->lc, out, spine, offset);
+      write_spine(r->rc, out, spine, offset);
+    } else {
+      auto c = Tree::cast_to_compressed(a);
+      size_t bytes = c->size_in_bytes;
+      uint8_t* tmp = utils::new_array_no_init<uint8_t>(round_up(bytes));
+      memcpy(tmp, c, bytes);
+      memset(tmp + bytes, 0, round_up(bytes) - bytes);
+      ((node_size_t*)tmp)[0] = kPinned;  // the reference count
+      out.write((const char*)tmp, round_up(bytes));
+      utils::free_array(tmp, round_up(bytes));
+
+      uint64_t off = offset;
+      spine.push_back((char)kCompressed);
+      spine.append((const char*)&off, sizeof(off));
+      offset += round_up(bytes);
+    }
+  }
+
+  static void save(node* root, const std::string& path) {
+    std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+      perror("snapshot save: open");
+      exit(-1);
+    }
+    snapshot_header h;
+    memcpy(h.magic, kMagic, sizeof(kMagic));
+    h.version = kVersion;
+    h.type_hash = type_hash();
+    h.block_size = Tree::B;
+    h.entry_bytes = sizeof(ET);
+    h.num_entries = Tree::size(root);
+
+    std::string zeros(round_up(sizeof(h)), '\0');
+    out.write(zeros.data(), zeros.size());
+    size_t offset = zeros.size();
+    std::string spine;
+    write_spine(root, out, spine, offset);
+    h.spine_offset = offset;
+    h.spine_bytes = spine.size();
+    out.write(spine.data(), spine.size());
+    out.seekp(0);
+    out.write((const char*)&h, sizeof(h));
+    out.close();
+    if (!out) {
+      perror("snapshot save: write");
+      exit(-1);
+    }
+  }
+
+  static node* read_spine(uint8_t* base, const uint8_t*& p) {
+    uint8_t t = *p++;
+    if (t == kEmpty) return Tree::empty();
+    if (t == kCompressed) {
+      uint64_t off;
+      memcpy(&off, p, sizeof(off));
+      p += sizeof(off);
+      return (node*)(base + off);
+    }
+    alignas(ET) uint8_t e[sizeof(ET)];
+    memcpy(e, p, sizeof(ET));
+    p += sizeof(ET);
+    regular_node* r = Tree::make_regular_node(*(ET*)e);
+    if constexpr (kBalanceBytes > 0) {
+      memcpy(static_cast<balance_t*>(r), p, kBalanceBytes);
+      p += kBalanceBytes;
+    }
+    r->lc = read_spine(base, p);
+    r->rc = read_spine(base, p);
+    Tree::update(r);
+    return r;
+  }
+
+  static node* open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+      perror("snapshot open: open");
+      exit(-1);
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) == -1) {
+      perror("snapshot open: fstat");
+      exit(-1);
+    }
+    size_t n = sb.st_size;
+    if (n < sizeof(snapshot_header)) {
+      std::cout << "snapshot open: " << path << " is not a snapshot" << std::endl;
+      exit(-1);
+    }
+    // Private and writable: reference counts of the mapped nodes change.
+    uint8_t* base = static_cast<uint8_t*>(
+        mmap(0, n, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0));
+    if (base == MAP_FAILED) {
+      perror("snapshot open: mmap");
+      exit(-1);
+    }
+    if (close(fd) == -1) {
+      perror("snapshot open: close");
+      exit(-1);
+    }
+
+    snapshot_header h;
+    memcpy(&h, base, sizeof(h));
+    if (memcmp(h.magic, kMagic, sizeof(kMagic)) != 0 || h.version != kVersion ||
+        h.spine_offset + h.spine_bytes > n) {
+      std::cout << "snapshot open: " << path << " is not a snapshot" << std::endl;
+      exit(-1);
+    }
+    if (h.type_hash != type_hash() || h.block_size != Tree::B ||
+        h.entry_bytes != sizeof(ET)) {
+      std::cout << "snapshot open: " << path
+                << " was saved from a different map type" << std::endl;
+      exit(-1);
+    }
+    const uint8_t* p = base + h.spine_offset;
+    node* root = read_spine(base, p);
+    assert(Tree::size(root) == h.num_entries);
+    return root;
+  }
+};
+
+}  // namespace cpam
@@ -0,0 +1,113 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// *******************************************
+//   OPERATION STATISTICS
+// *******************************************
+
+// Counts of hot-path events (block decodes and encodes, expose conversions,
+// path copies, node allocations and frees) for one map type. Compile with
+// -DCPAM_STATS to enable them; otherwise every add() is a no-op and the
+// counters read as zero.
+//
+// Each thread counts into its own cache-line sized slot, so counting does
+// not add sharing between threads; counts() sums over the slots of all
+// threads that have counted so far.
+
+namespace cpam {
+
+struct op_counts {
+  size_t decodes = 0;        // blocks decoded in full
+  size_t encodes = 0;        // blocks encoded
+  size_t bytes_encoded = 0;  // bytes of the blocks encoded
+  size_t exposes = 0;        // blocks exposed as a tree of regular nodes
+  size_t path_copies = 0;    // shared nodes copied by an update
+  size_t allocs = 0;         // nodes allocated, regular or compressed
+  size_t frees = 0;          // nodes freed, regular or compressed
+
+  op_counts operator-(const op_counts& o) const {
+    return {decodes - o.decodes, encodes - o.encodes,
+            bytes_encoded - o.bytes_encoded, exposes - o.exposes,
+            path_copies - o.path_copies, allocs - o.allocs, frees - o.frees};
+  }
+};
+
+#ifdef CPAM_STATS
+static constexpr bool kStatsEnabled = true;
+#else
+static constexpr bool kStatsEnabled = false;
+#endif
+
+// One set of counters per Tag (the node type of a map).
+template <class Tag>
+struct op_stats {
+  enum counter { kDecodes, kEncodes, kBytesEncoded, kExposes, kPathCopies,
+                 kAllocs, kFrees, kNumCounters };
+
+  static inline void add(counter c, size_t n = 1) {
+    if constexpr (kStatsEnabled) {
+      // Only the owning thread writes its slot.
+      auto& x = local().c[c];
+      x.store(x.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+  }
+
+  static op_counts counts() {
+    size_t tot[kNumCounters] = {};
+    if constexpr (kStatsEnabled) {
+      std::lock_guard<std::mutex> lock(registry().mu);
+      for (auto& s : registry().slots) {
+        for (size_t i = 0; i < kNumCounters; i++) {
+          tot[i] += s->c[i].load(std::memory_order_relaxed);
+        }
+      }
+    }
+    return {tot[kDecodes], tot[kEncodes], tot[kBytesEncoded], tot[kExposes],
+            tot[kPathCopies], tot[kAllocs], tot[kFrees]};
+  }
+
+  // Not atomic with respect to concurrent add()s.
+  static void reset() {
+    if constexpr (kStatsEnabled) {
+      std::lock_guard<std::mutex> lock(registry().mu);
+      for (auto& s : registry().slots) {
+        for (size_t i = 0; i < kNumCounters; i++) {
+          s->c[i].store(0, std::memory_order_relaxed);
+        }
+      }
+    }
+  }
+
+ private:
+  struct alignas(64) slot {
+    std::atomic<size_t> c[kNumCounters] = {};
+  };
+
+  // Slots outlive their threads, so counts() includes exited threads.
+  struct slot_registry {
+    std::mutex mu;
+    std::vector<std::unique_ptr<slot>> slots;
+  };
+
+  static slot_registry& registry() {
+    static slot_registry r;
+    return r;
+  }
+
+  static slot* new_slot() {
+    auto& r = registry();
+    std::lock_guard<std::mutex> lock(r.mu);
+    r.slots.push_back(std::make_unique<slot>());
+    return r.slots.back().get();
+  }
+
+  static slot& local() {
+    thread_local slot* s = new_slot();
+    return *s;
+  }
+};
+
+}  // namespace cpam
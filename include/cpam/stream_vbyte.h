@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__SSSE3__)
+#include <immintrin.h>
+#endif
+
+namespace cpam {
+
+// Shuffle masks for stream_vbyte: entry c maps the bytes of a group with
+// control bits c to their lanes (0x80 zeroes the byte), together with the
+// group's data length. Narrow lanes index by a whole control byte, wide lanes
+// by a nibble.
+template <class L>
+struct stream_vbyte_table {
+  static constexpr bool wide = (sizeof(L) == 8);
+  static constexpr size_t kGroups = wide ? 16 : 256;
+  static constexpr size_t kPerGroup = wide ? 2 : 4;
+
+  struct table {
+    uint8_t mask[kGroups][16];
+    uint8_t len[kGroups];
+  };
+
+  static constexpr size_t code_length(size_t c) {
+    return wide ? (size_t(1) << c) : c + 1;
+  }
+
+  static constexpr table make() {
+    table t{};
+    for (size_t c = 0; c < kGroups; c++) {
+      size_t off = 0;
+      for (size_t j = 0; j < kPerGroup; j++) {
+        size_t len = code_length((c >> (2 * j)) & 3);
+        for (size_t b = 0; b < sizeof(L); b++) {
+          t.mask[c][j * sizeof(L) + b] = (b < len) ? uint8_t(off + b) : 0x80;
+        }
+        off += len;
+      }
+      t.len[c] = off;
+    }
+    return t;
+  }
+
+  alignas(16) static constexpr table value = make();
+};
+
+// Stream-VByte style coding of unsigned integers (Lemire et al.). Lengths are
+// stored as 2-bit codes, four to a control byte, in a stream separate from the
+// data bytes, so a whole group can be decoded with a single table lookup and
+// byte shuffle instead of a branch per byte as in decodeUnsigned.
+//
+// L is the lane type (uint32_t or uint64_t). For 32-bit lanes the codes give
+// lengths 1, 2, 3, 4 and a control byte is decoded as one 16-byte shuffle; for
+// 64-bit lanes the codes give lengths 1, 2, 4, 8 and each half of a control
+// byte is decoded as one 16-byte shuffle producing two values.
+//
+// Data is stored little-endian.
+template <class L>
+struct stream_vbyte {
+  static_assert(std::is_same_v<L, uint32_t> || std::is_same_v<L, uint64_t>,
+                "stream_vbyte lanes are uint32_t or uint64_t");
+  static constexpr bool wide = (sizeof(L) == 8);
+
+  static constexpr size_t code_length(uint8_t c) {
+    return wide ? (size_t(1) << c) : size_t(c) + 1;
+  }
+
+  static inline uint8_t code(L d) {
+    if constexpr (wide) {
+      return (d < (L(1) << 8)) ? 0 : (d < (L(1) << 16)) ? 1 : (d < (L(1) << 32)) ? 2 : 3;
+    } else {
+      return (d < (L(1) << 8)) ? 0 : (d < (L(1) << 16)) ? 1 : (d < (L(1) << 24)) ? 2 : 3;
+    }
+  }
+
+  static inline size_t control_bytes(size_t n) { return (n + 3) / 4; }
+
+  static inline size_t data_bytes(L d) { return code_length(code(d)); }
+
+  // Writes the i-th value of a stream to data and returns the number of data
+  // bytes used. The control bytes must be zeroed beforehand.
+  static inline size_t put(uint8_t* ctrl, uint8_t* data, size_t i, L d) {
+    uint8_t c = code(d);
+    ctrl[i / 4] |= c << (2 * (i % 4));
+    size_t len = code_length(c);
+    std::memcpy(data, &d, len);
+    return len;
+  }
+
+  static inline L get(const uint8_t* data, uint8_t c) {
+    switch (code_length(c)) {
+      case 1: return data[0];
+      case 2: { uint16_t v; std::memcpy(&v, data, 2); return v; }
+      case 3: { uint32_t v = 0; std::memcpy(&v, data, 3); return v; }
+      case 4: { uint32_t v; std::memcpy(&v, data, 4); return v; }
+      default: { L v; std::memcpy(&v, data, sizeof(L)); return v; }
+    }
+  }
+
+  static constexpr auto& table = stream_vbyte_table<L>::value;
+
+  // Decodes n values starting at a group boundary and writes their running
+  // sum, starting from prev, to out. ctrl and data are advanced past the
+  // consumed groups; if n is not a multiple of four the stream must not be
+  // continued afterwards. end bounds the data stream: 16-byte loads are only
+  // issued when they stay below it, the remaining values are decoded scalar.
+  static inline void decode_prefix(uint8_t*& ctrl, uint8_t*& data,
+                                   const uint8_t* end, size_t n, L prev, L* out) {
+    size_t i = 0;
+#if defined(__SSSE3__)
+    if constexpr (wide) {
+      __m128i carry = _mm_set1_epi64x(prev);
+      for (; i + 4 <= n && data + table.len[*ctrl & 0xf] + 16 <= end; i += 4) {
+        uint8_t c = *ctrl++;
+        for (size_t h = 0; h < 2; h++) {
+          uint8_t g = (c >> (4 * h)) & 0xf;
+          __m128i v = _mm_loadu_si128((const __m128i*)data);
+          v = _mm_shuffle_epi8(v, _mm_loadu_si128((const __m128i*)table.mask[g]));
+          v = _mm_add_epi64(v, _mm_slli_si128(v, 8));
+          v = _mm_add_epi64(v, carry);
+          _mm_storeu_si128((__m128i*)(out + i + 2 * h), v);
+          carry = _mm_unpackhi_epi64(v, v);
+          data += table.len[g];
+        }
+      }
+    } else {
+      __m128i carry = _mm_set1_epi32(prev);
+      for (; i + 4 <= n && data + 16 <= end; i += 4) {
+        uint8_t c = *ctrl++;
+        __m128i v = _mm_loadu_si128((const __m128i*)data);
+        v = _mm_shuffle_epi8(v, _mm_loadu_si128((const __m128i*)table.mask[c]));
+        v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+        v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+        v = _mm_add_epi32(v, carry);
+        _mm_storeu_si128((__m128i*)(out + i), v);
+        carry = _mm_shuffle_epi32(v, 0xff);
+        data += table.len[c];
+      }
+    }
+    if (i > 0) prev = out[i - 1];
+#endif
+    for (; i < n; i++) {
+      uint8_t c = (*ctrl >> (2 * (i % 4))) & 3;
+      prev += get(data, c);
+      data += code_length(c);
+      out[i] = prev;
+      if (i % 4 == 3) ctrl++;
+    }
+  }
+};
+
+}  // namespace cpam
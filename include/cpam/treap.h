@@ -0,0 +1,131 @@
+#pragma once
+#include "balance_utils.h"
+
+// *******************************************
+//   TREAPS
+// *******************************************
+
+namespace cpam {
+
+struct treap {
+
+  struct data { unsigned int priority; };
+
+  // A regular node draws its priority (a hash of its address) when it is
+  // made, and copies keep it. Blocks, and the regular nodes made above
+  // blocks by make_compressed, have priority 0. Pieces too small to be a
+  // child (see balance_utils) are merged into the leaf at the end of the
+  // other tree's spine.
+  //
+  // defines: node_join, regular_node_join, is_balanced, check_structure
+  // redefines: make_regular_node, single, make_compressed
+  // inherits: update
+  template<class Node>
+  struct balance : public Node {
+    using node = typename Node::node;
+    using regular_node = typename Node::regular_node;
+    using t_utils = balance_utils<balance>;
+    using GC = gc<balance>;
+    using ET = typename Node::ET;
+    using Node::B;
+    friend t_utils;
+
+    static node* node_join(node* t1, node* t2, regular_node* k) {
+      if (t_utils::is_small_join(t1, t2)) return t_utils::small_join(t1, t2, k);
+      bool small1 = t_utils::is_small(t1), small2 = t_utils::is_small(t2);
+      if (!small1 && !small2 &&
+          k->priority >= priority(t1) && k->priority >= priority(t2)) {
+        k->lc = t1;
+        k->rc = t2;
+        Node::update(k);
+        return k;
+      } else if (small2 || (!small1 && priority(t1) > priority(t2))) {
+        regular_node* t = Node::cast_to_regular(GC::copy_if_needed(t1));
+        t->rc = node_join(t->rc, t2, k);
+        Node::update(t);
+        return t;
+      } else {
+        regular_node* t = Node::cast_to_regular(GC::copy_if_needed(t2));
+        t->lc = node_join(t1, t->lc, k);
+        Node::update(t);
+        return t;
+      }
+    }
+
+    // For trees of regular nodes only.
+    static regular_node* regular_node_join(regular_node* t1, regular_node* t2, regular_node* k) {
+      if (k->priority >= priority(t1) && k->priority >= priority(t2)) {
+        k->lc = t1;
+        k->rc = t2;
+        Node::update(k);
+        return k;
+      } else if (priority(t1) > priority(t2)) {
+        regular_node* t = Node::cast_to_regular(GC::copy_if_needed(t1));
+        t->rc = regular_node_join(Node::cast_to_regular(t->rc), t2, k);
+        Node::update(t);
+        return t;
+      } else {
+        regular_node* t = Node::cast_to_regular(GC::copy_if_needed(t2));
+        t->lc = regular_node_join(t1, Node::cast_to_regular(t->lc), k);
+        Node::update(t);
+        return t;
+      }
+    }
+
+    static inline bool is_balanced(regular_node* t) {
+      return !t || (t->priority >= priority(t->lc) && t->priority >= priority(t->rc));
+    }
+
+    static regular_node* make_regular_node(const ET& e) {
+      regular_node* o = Node::make_regular_node(e);
+      o->priority = new_priority(o);
+      return o;
+    }
+
+    static regular_node* single(const ET& e) {
+      regular_node* o = Node::single(e);
+      o->priority = new_priority(o);
+      return o;
+    }
+
+    static node* make_compressed(node* l, node* r, regular_node* e) {
+      return clear_priorities(Node::make_compressed(l, r, e));
+    }
+
+    static node* make_compressed(ET* stack, size_t tot) {
+      return clear_priorities(Node::make_compressed(stack, tot));
+    }
+
+    static node* make_compressed(node* l, node* r) {
+      return make_compressed(l, r, nullptr);
+    }
+
+    static bool check_structure(node* b, size_t orig_tree_size = std::numeric_limits<size_t>::max()) {
+      return t_utils::check_structure(b, orig_tree_size);
+    }
+
+  private:
+    static unsigned int priority(node* a) {
+      if (a == NULL || Node::is_compressed(a)) return 0;
+      return Node::cast_to_regular(a)->priority;
+    }
+
+    static unsigned int new_priority(regular_node* o) {
+      return (unsigned int)parlay::hash64((uint64_t)o);
+    }
+
+    static node* clear_priorities(node* a) {
+      if (a && Node::is_regular(a)) {
+        auto r = Node::cast_to_regular(a);
+        clear_priorities(r->lc);
+        clear_priorities(r->rc);
+        r->priority = 0;
+      }
+      return a;
+    }
+
+    static bool check_node(regular_node* t) { return is_balanced(t); }
+  };
+};
+
+}  // namespace cpam
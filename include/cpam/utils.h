@@ -1,5 +1,6 @@
 #pragma once
 #include <optional>
+#include <type_traits>
 #include <string.h>
 
 #include <parlay/internal/binary_search.h>
@@ -106,24 +107,30 @@ namespace utils {
     }
   }
 
+  // Integers use the atomic fetch-add instruction (the __atomic builtins
+  // std::atomic is built on, as the counters are plain fields); other types
+  // fall back to a CAS loop.
   template <typename E, typename EV>
   inline E fetch_and_add(E *a, EV b) {
-    volatile E newV, oldV;
-    do {oldV = *a; newV = oldV + b;}
-    while (!atomic_compare_and_swap(a, oldV, newV));
-    return oldV;
+    if constexpr (std::is_integral_v<E>) {
+      return __atomic_fetch_add(a, (E)b, __ATOMIC_SEQ_CST);
+    } else {
+      volatile E newV, oldV;
+      do {oldV = *a; newV = oldV + b;}
+      while (!atomic_compare_and_swap(a, oldV, newV));
+      return oldV;
+    }
   }
 
   template <typename E, typename EV>
   inline void write_add(E *a, EV b) {
-    //volatile E newV, oldV;
-    //if (start_logging) {
-    //  assert(false);
-    //  std::cout << "Write adding a value of: " << b << std::endl;
-    //}
-    E newV, oldV;
-    do {oldV = *a; newV = oldV + b;}
-    while (!atomic_compare_and_swap(a, oldV, newV));
+    if constexpr (std::is_integral_v<E>) {
+      __atomic_fetch_add(a, (E)b, __ATOMIC_SEQ_CST);
+    } else {
+      E newV, oldV;
+      do {oldV = *a; newV = oldV + b;}
+      while (!atomic_compare_and_swap(a, oldV, newV));
+    }
   }
 
   template <typename F, typename AT>
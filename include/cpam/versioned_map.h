@@ -0,0 +1,310 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace cpam {
+
+// *******************************************
+//   VERSIONED MAPS
+// *******************************************
+
+// Keeps the timestamped versions of a map (pam_map, aug_map, pam_set, ...)
+// that readers still use. commit() publishes a new version with the next
+// timestamp; readers acquire the latest version, or the one committed at a
+// given timestamp, and the version stays valid until the handle is
+// destroyed. A version is reclaimed (through GC::retire, so deferred
+// reclamation applies) once it is no longer the latest and no reader holds
+// it; acquire_at() then no longer finds it.
+//
+// Acquiring and releasing are lock-free: each version has a slot with a
+// count of its readers, plus one while it is the latest, and a reader only
+// increments a count that is still non-zero. The slot of a reclaimed version
+// is reused, so there are about as many slots as versions live at once
+// rather than one per commit. As in Aspen's table of versions, slots are
+// found by probing a table from their timestamp; the table is rebuilt from
+// the live slots when half of it is used, and a replaced table is freed once
+// no lookup can still be reading it. Commits are serialized by a lock that
+// is held only while the new version is published, so neither the function
+// given to update() nor the reclamation of the replaced version runs under
+// it.
+template <class Map>
+struct versioned_map {
+  using M = Map;
+  using node = typename M::node;
+  using GC = typename M::GC;
+  using timestamp = size_t;
+
+ private:
+  // state packs the low 32 bits of the timestamp above the count, so that a
+  // reader only counts itself in the version it looked up.
+  struct slot {
+    std::atomic<uint64_t> state;  // (tag << 32) | refs; refs is 0 once reclaimed
+    std::atomic<bool> in_use;     // false once reclaimed: the slot can be reused
+    timestamp ts;
+    node* root;
+  };
+  static constexpr uint64_t kRefMask = (uint64_t{1} << 32) - 1;
+  static uint64_t tag_of(timestamp t) { return (uint64_t)(uint32_t)t << 32; }
+
+  static constexpr size_t kInitialSlots = 8;
+  static constexpr size_t kInitialTableSize = 16;
+
+  // Open addressing with linear probing. Entries are never cleared, only
+  // overwritten once their slot is reclaimed, so probes stop at the first
+  // null entry.
+  struct slot_table {
+    size_t size;  // a power of two
+    std::unique_ptr<std::atomic<slot*>[]> entries;
+    size_t used = 0;  // non-null entries
+
+    explicit slot_table(size_t size)
+      : size(size), entries(new std::atomic<slot*>[size]) {
+      for (size_t i = 0; i < size; i++) entries[i].store(nullptr, std::memory_order_relaxed);
+    }
+  };
+
+ public:
+  // A reader's reference to one version. The map is borrowed from the
+  // version: copy it to keep it after the handle is destroyed.
+  class version {
+   public:
+    version(version&& v) : vm(v.vm), s(v.s), ts(v.ts), m(std::move(v.m)) {
+      v.vm = nullptr;
+    }
+    version(const version&) = delete;
+    version& operator = (const version&) = delete;
+    ~version() {
+      if (vm) {
+        m.get_root();  // relinquish without decrementing the tree
+        vm->release(s);
+      }
+    }
+
+    timestamp get_timestamp() const { return ts; }
+    const M& map() const { return m; }
+
+   private:
+    friend struct versioned_map;
+    version(versioned_map* vm, slot* s, timestamp ts, node* root)
+      : vm(vm), s(s), ts(ts), m(root) {}
+
+    versioned_map* vm;
+    slot* s;
+    timestamp ts;
+    M m;
+  };
+
+  explicit versioned_map(M initial = M())
+    : table(new slot_table(kInitialTableSize)) {
+    latest_slot = publish(0, initial.get_root());
+    latest.store(0);
+  }
+
+  // Outstanding versions must be released first.
+  ~versioned_map() {
+    release(latest_slot);
+    delete table.load();
+  }
+
+  versioned_map(const versioned_map&) = delete;
+  versioned_map& operator = (const versioned_map&) = delete;
+
+  timestamp latest_timestamp() const { return latest.load(std::memory_order_acquire); }
+
+  version acquire_latest() {
+    while (true) {
+      timestamp t = latest_timestamp();
+      if (auto v = try_acquire(t)) return std::move(*v);
+      // t was replaced and reclaimed since we read it: retry
+    }
+  }
+
+  // The version committed at t, if it is still live.
+  std::optional<version> acquire_at(timestamp t) {
+    if (t > latest_timestamp()) return std::nullopt;
+    return try_acquire(t);
+  }
+
+  // Makes m the latest version and returns its timestamp. The previous
+  // latest version is reclaimed once its readers release it.
+  timestamp commit(M m) {
+    return *try_commit(m, std::nullopt);
+  }
+
+  // Applies f to the latest version and commits the result, unless another
+  // version was committed in the meantime: f is then applied again, to the
+  // new latest version, so no commit is overwritten. f runs without any
+  // lock held, so it may be parallel, and update may be called from inside
+  // parallel loops.
+  template <class F>
+  timestamp update(const F& f) {
+    while (true) {
+      auto v = acquire_latest();
+      M m = f(v.map());
+      if (auto t = try_commit(m, v.get_timestamp())) return *t;
+    }
+  }
+
+  // In deferred mode (GC::set_deferred(true)), reclaimed versions are only
+  // queued; this frees them, in parallel, and returns their number.
+  size_t collect_garbage() { return GC::collect(); }
+
+  // The number of version slots allocated, which follows the number of
+  // versions live at once.
+  size_t num_slots() {
+    std::lock_guard<std::mutex> g(commit_lock);
+    return slots.size();
+  }
+
+ private:
+  std::atomic<slot_table*> table;
+  std::atomic<size_t> lookups{0};  // in progress; see find
+  std::atomic<timestamp> latest;
+  std::mutex commit_lock;
+
+  // Guarded by commit_lock.
+  slot* latest_slot;
+  std::vector<std::unique_ptr<slot[]>> chunks;
+  std::vector<slot*> slots;
+  size_t next_slot = 0;  // where take_slot resumes
+  std::vector<std::unique_ptr<slot_table>> replaced;
+
+  // Publishes m as the next version if the latest one is still expected
+  // (always, without one); m is left untouched otherwise. The replaced
+  // version is released after commit_lock is dropped, since reclaiming it
+  // may run in parallel.
+  std::optional<timestamp> try_commit(M& m, std::optional<timestamp> expected) {
+    timestamp t;
+    slot* prev;
+    {
+      std::lock_guard<std::mutex> g(commit_lock);
+      if (expected && *expected != latest.load()) return std::nullopt;
+      t = latest.load() + 1;
+      prev = latest_slot;
+      latest_slot = publish(t, m.get_root());
+      latest.store(t, std::memory_order_release);
+    }
+    release(prev);
+    return t;
+  }
+
+  // Called with commit_lock held (or by the constructor).
+  slot* publish(timestamp t, node* root) {
+    slot* s = take_slot();
+    s->in_use.store(true, std::memory_order_relaxed);
+    s->ts = t;
+    s->root = root;
+    s->state.store(tag_of(t) | 1, std::memory_order_release);
+
+    slot_table* tab = table.load(std::memory_order_relaxed);
+    if (2 * (tab->used + 1) > tab->size) tab = rebuild_table();
+    size_t mask = tab->size - 1;
+    for (size_t i = t & mask; ; i = (i + 1) & mask) {
+      slot* e = tab->entries[i].load(std::memory_order_relaxed);
+      if (e == nullptr) tab->used++;
+      if (e == nullptr || e == s || !e->in_use.load(std::memory_order_acquire)) {
+        tab->entries[i].store(s, std::memory_order_release);
+        break;
+      }
+    }
+    if (!replaced.empty() && lookups.load() == 0) replaced.clear();
+    return s;
+  }
+
+  // A slot whose version was reclaimed, or a new one. At most half of the
+  // slots are scanned before their number is doubled, so that commits take
+  // constant amortized time.
+  slot* take_slot() {
+    size_t n = slots.size();
+    for (size_t i = 0; i < (n + 1) / 2; i++) {
+      slot* s = slots[next_slot];
+      next_slot = (next_slot + 1) % n;
+      // acquire: the reclaiming reader is done with the slot
+      if (!s->in_use.load(std::memory_order_acquire)) return s;
+    }
+    size_t k = std::max(n, kInitialSlots);
+    chunks.emplace_back(new slot[k]);
+    for (size_t i = 0; i < k; i++) {
+      slot* s = &chunks.back()[i];
+      s->state.store(0, std::memory_order_relaxed);
+      s->in_use.store(false, std::memory_order_relaxed);
+      s->ts = 0;
+      s->root = nullptr;
+      slots.push_back(s);
+    }
+    next_slot = n + 1;
+    return slots[n];
+  }
+
+  // Replaces the table by one holding only the live slots, with room for
+  // as many commits again. The old table is kept in replaced until no
+  // lookup is in progress. Sequential, since commit_lock is held.
+  slot_table* rebuild_table() {
+    std::vector<slot*> live;
+    for (slot* s : slots) {
+      if (s->in_use.load(std::memory_order_relaxed)) live.push_back(s);
+    }
+    size_t size = kInitialTableSize;
+    while (size < 4 * (live.size() + 1)) size *= 2;
+    auto tab = new slot_table(size);
+    for (slot* s : live) {
+      size_t i = s->ts & (size - 1);
+      while (tab->entries[i].load(std::memory_order_relaxed)) i = (i + 1) & (size - 1);
+      tab->entries[i].store(s, std::memory_order_relaxed);
+      tab->used++;
+    }
+    replaced.emplace_back(table.load());
+    table.store(tab);  // seq_cst, ordered before reading lookups
+    return tab;
+  }
+
+  // The slot last holding version t, if the table has one. A lookup counts
+  // itself in lookups while it reads the table, so that a replaced table is
+  // only freed when it is zero; slots are never freed while the
+  // versioned_map lives.
+  slot* find(timestamp t) {
+    lookups.fetch_add(1);
+    slot_table* tab = table.load();
+    size_t mask = tab->size - 1;
+    slot* found = nullptr;
+    for (size_t i = t & mask, probes = 0; probes < tab->size; i = (i + 1) & mask, probes++) {
+      slot* e = tab->entries[i].load(std::memory_order_acquire);
+      if (e == nullptr) break;
+      if ((e->state.load(std::memory_order_acquire) & ~kRefMask) == tag_of(t)) {
+        found = e;
+        break;
+      }
+    }
+    lookups.fetch_sub(1, std::memory_order_release);
+    return found;
+  }
+
+  std::optional<version> try_acquire(timestamp t) {
+    slot* s = find(t);
+    if (!s) return std::nullopt;
+    uint64_t st = s->state.load(std::memory_order_acquire);
+    while ((st & ~kRefMask) == tag_of(t) && (st & kRefMask) > 0) {
+      if (s->state.compare_exchange_weak(st, st + 1, std::memory_order_acq_rel)) {
+        if (s->ts == t) return version(this, s, t, s->root);
+        release(s);  // the slot holds a version 2^32 commits later
+        return std::nullopt;
+      }
+    }
+    return std::nullopt;
+  }
+
+  void release(slot* s) {
+    if ((s->state.fetch_sub(1, std::memory_order_acq_rel) & kRefMask) == 1) {
+      node* root = s->root;
+      s->root = nullptr;
+      s->in_use.store(false, std::memory_order_release);
+      if (root) GC::retire(root);
+    }
+  }
+};
+
+}  // namespace cpam